@@ -0,0 +1,91 @@
+// include Arduino.h first to avoid squiggles
+#include <Arduino.h>
+
+// configs
+#include <configs/HARDWARE_config.h>
+#include <configs/HTTP_config.h>
+#include <configs/TLS_config.h>
+
+// bricks
+#include <bricks/simcom_handler.h>
+
+// libs
+#include <StatusLogger.h>
+
+/*
+ * TLS handshake benchmark. Flash it once per profile and compare the serial output:
+ *   pio run -e bench_tls -t upload -t monitor
+ *   pio run -e bench_tls_ecdsa -t upload -t monitor
+ *
+ * Each line is CSV: TLS_BENCH,profile,host,attempt,kind,connected,handshake_ms,ram_per_client,min_free_heap,stack_hwm
+ * The first handshake to a host is a full handshake, the following ones resume the session SSLClient cached.
+ */
+
+static_assert(!SimcomModem::SSL_ON_MODEM, "This benchmark measures SSLClient, which isn't used when the module does TLS itself (e.g. the SIM7070G).");
+static_assert(SimcomModem::SOCKET_COUNT >= 4, "This benchmark needs a spare socket (mux 3).");
+
+const int HANDSHAKES_PER_HOST = 5;
+
+TinyGsmClient bench_client(SIMCOMHandler::modem, 3); // a spare mux, so we don't disturb the app's clients
+
+/**
+ * @brief Measure the RAM of one SSLClient and the time of a few handshakes to a host
+ *
+ * @param host the host to handshake with (on port 443)
+ */
+void benchmarkHost(const char *host)
+{
+    uint32_t heap_before = ESP.getFreeHeap();
+    SSLClient *bench_client_secured = new SSLClient(bench_client, TAs, (size_t)TAs_NUM, RESERVED_NOISE_PIN); // verifies against the firmware's compile time, which is fine for a fresh flash
+    uint32_t ram_per_client = heap_before - ESP.getFreeHeap();
+
+    for (int attempt = 0; attempt < HANDSHAKES_PER_HOST; attempt++)
+    {
+        unsigned long start_time = millis();
+        bool connected = bench_client_secured->connect(host, 443);
+        unsigned long handshake_ms = millis() - start_time;
+
+        Serial.printf("TLS_BENCH,%s,%s,%d,%s,%d,%lu,%u,%u,%u\n",
+                      TLS_PROFILE_NAME,
+                      host,
+                      attempt,
+                      attempt == 0 ? "full" : "resumed",
+                      connected,
+                      handshake_ms,
+                      ram_per_client,
+                      ESP.getMinFreeHeap(),
+                      uxTaskGetStackHighWaterMark(NULL));
+
+        bench_client_secured->stop();
+        delay(1000);
+    }
+    delete bench_client_secured;
+}
+
+void setup()
+{
+    Serial.begin(SERIAL_MON_BAUD);
+
+    if (SIMCOMHandler::setupSIMModule() == SIMCOMHandler::FAILED_TO_AT)
+    {
+        StatusLogger::log(StatusLogger::LEVEL_ERROR, StatusLogger::NAME_SIMCOM, "Can't talk to the SIMCOM module, no benchmark today.");
+        return;
+    }
+    while (SIMCOMHandler::connectToInternet() != SIMCOMHandler::INTERNET_READY)
+    {
+        delay(2000);
+    }
+    if (!SIMCOMHandler::updateSSLTime())
+    {
+        StatusLogger::log(StatusLogger::LEVEL_WARNING, StatusLogger::NAME_SIMCOM, "SSL time not updated, expect handshakes to fail.");
+    }
+
+    Serial.printf("TLS_BENCH,profile,host,attempt,kind,connected,handshake_ms,ram_per_client,min_free_heap,stack_hwm\n");
+    benchmarkHost(OPEN_METEO_URL);
+    benchmarkHost(BEECEPTOR_URL);
+    Serial.println("TLS_BENCH,done");
+}
+
+void loop()
+{
+}
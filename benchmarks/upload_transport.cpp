@@ -0,0 +1,128 @@
+// include Arduino.h first to avoid squiggles
+#include <Arduino.h>
+
+// configs
+#include <configs/HARDWARE_config.h>
+#include <configs/HTTP_config.h>
+#include <configs/MQTT_config.h>
+
+// bricks
+#include <bricks/simcom_handler.h>
+#include <bricks/aggregator.h>
+#include <bricks/log_sink.h>
+#include <bricks/modem_task.h>
+#include <http_handler.h>
+
+// libs
+#include <MQTTClient.h>
+#include <StatusLogger.h>
+
+/*
+ * Upload transport benchmark: the same telemetry message sent N times over HTTP and then over MQTT (QoS1 publishes on
+ * one session), counting the bytes on air and the latency of each message.
+ *   pio run -e bench_transport -t upload -t monitor
+ * Both go the way the firmware sends its uploads: HTTP through HTTP::postPipelined() to beeceptor, MQTT on beeceptor's
+ * secured client, both over beeceptor's client stack (resolving, counting and modem task clients included).
+ * Point MQTT_URL/MQTT_PORT at a broker you run yourself, see the env's build_flags. Its root CA must be in
+ * trust_anchors.h.
+ *
+ * Each line is CSV: TRANSPORT_BENCH,transport,message,kind,payload_bytes,tx_bytes,rx_bytes,latency_ms,ok
+ * tx/rx bytes are what went through the modem's socket (TLS records included, IP/TCP headers not).
+ * The "first" message also pays for the TLS handshake (and the MQTT CONNECT), the "steady" ones are the per-message cost.
+ */
+
+static_assert(!SimcomModem::SSL_ON_MODEM, "This benchmark counts bytes under SSLClient, which isn't used when the module does TLS itself (e.g. the SIM7070G).");
+
+const int MESSAGES_PER_TRANSPORT = 10;
+
+CountingClient &bench_client_counted = SIMCOMHandler::beeceptor_stack.counted;
+
+/**
+ * @brief Print one CSV row, for the bytes counted since the last resetCounts()
+ */
+void printRow(const char *transport, int message, size_t payload_bytes, unsigned long latency_ms, bool ok)
+{
+    Serial.printf("TRANSPORT_BENCH,%s,%d,%s,%u,%u,%u,%lu,%d\n",
+                  transport,
+                  message,
+                  message == 0 ? "first" : "steady",
+                  (unsigned)payload_bytes,
+                  (unsigned)bench_client_counted.bytes_written,
+                  (unsigned)bench_client_counted.bytes_read,
+                  latency_ms,
+                  ok);
+}
+
+/**
+ * @brief POST the payload the way the firmware does (a pipeline of one, on beeceptor's keep-alive connection)
+ */
+void benchmarkHTTP(const char *payload, size_t length)
+{
+    for (int message = 0; message < MESSAGES_PER_TRANSPORT; message++)
+    {
+        bench_client_counted.resetCounts();
+        unsigned long start_time = millis();
+        HTTPPipeline::Request request = {DATA_ENDPOINT, "application/json", payload, length, 0};
+        bool ok = HTTP::postPipelined(&request, 1) == 1 and request.response_status >= 200 and request.response_status < 300;
+        printRow("http", message, length, millis() - start_time, ok);
+        delay(1000);
+    }
+    SIMCOMHandler::beeceptor_stack.httpClient().stop(); // free the mux for the MQTT session
+}
+
+/**
+ * @brief Publish the payload at QoS1 over one MQTT session
+ */
+void benchmarkMQTT(const char *payload, size_t length)
+{
+    MQTTClient mqtt(MQTT_READ_BUFFER_SIZE, MQTT_WRITE_BUFFER_SIZE);
+    mqtt.begin(MQTT_URL, MQTT_PORT, SIMCOMHandler::beeceptor_stack.secureClient());
+    mqtt.setOptions(MQTT_KEEPALIVE_S, MQTT_CLEAN_SESSION, MQTT_COMMAND_TIMEOUT_MS);
+    for (int message = 0; message < MESSAGES_PER_TRANSPORT; message++)
+    {
+        bench_client_counted.resetCounts();
+        unsigned long start_time = millis();
+        bool ok = mqtt.connected() or mqtt.connect(MQTT_CLIENT_ID "-bench");
+        if (ok)
+        {
+            ok = mqtt.publish(MQTT_DATA_TOPIC, payload, (int)length, false, MQTT_QOS);
+        }
+        printRow("mqtt", message, length, millis() - start_time, ok);
+        delay(1000);
+        mqtt.loop();
+    }
+    mqtt.disconnect();
+    SIMCOMHandler::beeceptor_stack.secureClient().stop();
+}
+
+void setup()
+{
+    Serial.begin(SERIAL_MON_BAUD);
+    LogSink::begin();
+    ModemTask::begin(); // as in the firmware, the socket calls run on the modem task
+
+    if (SIMCOMHandler::setupSIMModule() == SIMCOMHandler::FAILED_TO_AT)
+    {
+        StatusLogger::log(StatusLogger::LEVEL_ERROR, StatusLogger::NAME_SIMCOM, "Can't talk to the SIMCOM module, no benchmark today.");
+        return;
+    }
+    while (SIMCOMHandler::connectToInternet() != SIMCOMHandler::INTERNET_READY)
+    {
+        delay(2000);
+    }
+
+    // A typical upload: one closed aggregation window, encoded exactly as the app would
+    Telemetry::TelemetryRecord sample = {1700000000, 12.5, 8.3, 245.0, 3, 1};
+    Aggregation::WindowAggregate window = {};
+    Telemetry::TelemetryRecordSchema::addToWindow(window, sample);
+    size_t length = Aggregation::encodeUploadBody(&window, 1);
+
+    Serial.printf("TRANSPORT_BENCH,transport,message,kind,payload_bytes,tx_bytes,rx_bytes,latency_ms,ok\n");
+    benchmarkHTTP(Aggregation::upload_body, length);
+    benchmarkMQTT(Aggregation::upload_body, length);
+    Serial.println("TRANSPORT_BENCH,done");
+}
+
+void loop()
+{
+}
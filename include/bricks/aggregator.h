@@ -0,0 +1,128 @@
+#pragma once
+
+// configs
+#include <configs/OPERATIONS_config.h>
+
+// bricks
+#include <bricks/telemetry_queue.h>
+
+// utils
+#include <utils/spsc_ring.h>
+
+// Folds raw samples from the telemetry queue into fixed-size windowed aggregates, so we only upload one aggregate
+// per window rather than every raw sample. Memory use is fixed: one open window, plus a ring of closed ones.
+namespace Aggregation
+{
+    typedef Telemetry::TelemetryRecordWindow WindowAggregate; // generated from the telemetry schema
+
+    WindowAggregate open_window;
+    unsigned long open_window_started_at = 0; // millis()
+    SPSCRing<WindowAggregate, AGGREGATE_QUEUE_LENGTH> closed_windows(RING_DROP_OLDEST);
+
+    uint32_t samples_total = 0;
+    uint32_t aggregates_total = 0;
+    uint32_t aggregates_uploaded = 0;
+    uint32_t aggregate_bytes_total = 0; // JSON bytes of the aggregates we've uploaded
+
+    char upload_body[2 + TELEMETRY_UPLOAD_BATCH * Telemetry::TelemetryRecordSchema::WINDOW_JSON_MAX_SIZE]; // [window,window,...], sized at compile time
+
+    /**
+     * @brief Fold one raw sample into the open window
+     *
+     * @param record the raw sample
+     */
+    void addSample(const Telemetry::TelemetryRecord &record)
+    {
+        Telemetry::TelemetryRecordSchema::addToWindow(open_window, record);
+        samples_total++;
+    }
+
+    /**
+     * @brief Close the open window (if it has any samples) and start a new one
+     */
+    void closeWindow()
+    {
+        if (open_window.count)
+        {
+            closed_windows.push(open_window);
+            aggregates_total++;
+        }
+        open_window.count = 0;
+        open_window_started_at = millis();
+    }
+
+    /**
+     * @brief Drain the raw samples from the telemetry queue into the open window, closing it when it's due.
+     * Call this often (i.e. every loop), the queue only holds TELEMETRY_QUEUE_LENGTH samples.
+     */
+    void update()
+    {
+        Telemetry::TelemetryRecord samples[TELEMETRY_UPLOAD_BATCH];
+        size_t count;
+        while ((count = Telemetry::queue.popBatch(samples, TELEMETRY_UPLOAD_BATCH)))
+        {
+            for (size_t i = 0; i < count; i++)
+            {
+                addSample(samples[i]);
+            }
+        }
+        if (millis() - open_window_started_at >= AGGREGATION_WINDOW_MS)
+        {
+            closeWindow();
+        }
+    }
+
+    /**
+     * @brief Encode a batch of windows (as a JSON array) into upload_body, whichever transport is going to send it
+     *
+     * @param windows the closed windows to encode
+     * @param count the number of windows (at most TELEMETRY_UPLOAD_BATCH)
+     * @returns the number of bytes written to upload_body
+     */
+    size_t encodeUploadBody(const WindowAggregate *windows, size_t count)
+    {
+        // Encode with the schema's generated writer, straight into a buffer sized at compile time (no allocations)
+        size_t body_length = 0;
+        upload_body[body_length++] = '[';
+        for (size_t i = 0; i < count; i++)
+        {
+            if (i)
+            {
+                upload_body[body_length++] = ',';
+            }
+            body_length += Telemetry::TelemetryRecordSchema::writeWindowJson(windows[i], upload_body + body_length, sizeof(upload_body) - body_length);
+        }
+        upload_body[body_length++] = ']';
+        return body_length;
+    }
+
+    /**
+     * @brief Print the raw sample and aggregate rates (to add to our status report), so you can size your windows against bandwidth
+     *
+     * @param stream the stream to print to
+     */
+    void printAggregationMetrics(Stream *stream)
+    {
+        float uptime_minutes = millis() / 60000.0;
+        stream->print("AGGREGATION: window_ms=");
+        stream->print(AGGREGATION_WINDOW_MS);
+        stream->print(", samples=");
+        stream->print(samples_total);
+        stream->print(", samples_per_min=");
+        stream->print(uptime_minutes > 0 ? samples_total / uptime_minutes : 0);
+        stream->print(", aggregates=");
+        stream->print(aggregates_total);
+        stream->print(", aggregates_per_min=");
+        stream->print(uptime_minutes > 0 ? aggregates_total / uptime_minutes : 0);
+        stream->print(", bytes_per_aggregate=");
+        stream->print(aggregates_uploaded ? aggregate_bytes_total / aggregates_uploaded : 0);
+        stream->print(", json_max_bytes=");
+        stream->print(Telemetry::TelemetryRecordSchema::WINDOW_JSON_MAX_SIZE - 1);
+        stream->print(", binary_bytes=");
+        stream->print(Telemetry::TelemetryRecordSchema::WINDOW_BINARY_SIZE);
+        stream->print(", pending=");
+        stream->print(closed_windows.size());
+        stream->print(", dropped=");
+        stream->println(closed_windows.droppedCount());
+    }
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+// configs
+#include <configs/OPERATIONS_config.h>
+
+// bricks
+#include <bricks/telemetry_queue.h>
+
+// Send-on-change: a sample only goes on to the queue (and so into an aggregate, and up to the server) if one of its
+// fields moved by more than that field's deadband since the last sample we sent, or the heartbeat is due. The Open
+// Meteo API returns the same observation for most of each hour, so most of our samples are repeats.
+// n.b. call it from one producer only, the snapshot isn't shared safely between tasks.
+namespace ChangeFilter
+{
+    Telemetry::TelemetryRecord last_sent; // compact snapshot of the last sample we let through
+    bool has_sent = false;
+    unsigned long last_sent_at = 0; // millis()
+
+    uint32_t samples_seen = 0;
+    uint32_t samples_suppressed = 0;
+    uint32_t heartbeats = 0; // samples sent only because the heartbeat was due
+
+    /**
+     * @brief Decide if a sample is worth sending, updating the last-sent snapshot if it is
+     *
+     * @param record the new sample
+     * @returns true if it changed enough (or the heartbeat is due), otherwise false
+     */
+    bool shouldSend(const Telemetry::TelemetryRecord &record)
+    {
+        samples_seen++;
+        bool has_changed = !has_sent or Telemetry::TelemetryRecordSchema::hasChanged(record, last_sent);
+        if (!has_changed and millis() - last_sent_at < CHANGE_FILTER_HEARTBEAT_MS)
+        {
+            samples_suppressed++;
+            return false;
+        }
+        if (!has_changed)
+        {
+            heartbeats++;
+        }
+        last_sent = record;
+        has_sent = true;
+        last_sent_at = millis();
+        return true;
+    }
+
+    /**
+     * @brief Print how many samples we suppressed (to add to our status report)
+     *
+     * @param stream the stream to print to
+     */
+    void printChangeFilterMetrics(Stream *stream)
+    {
+        stream->print("CHANGE_FILTER: seen=");
+        stream->print(samples_seen);
+        stream->print(", sent=");
+        stream->print(samples_seen - samples_suppressed);
+        stream->print(", suppressed=");
+        stream->print(samples_suppressed);
+        stream->print(", suppression_ratio=");
+        stream->print(samples_seen ? (float)samples_suppressed / samples_seen : 0);
+        stream->print(", heartbeats=");
+        stream->println(heartbeats);
+    }
+}
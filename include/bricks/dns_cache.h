@@ -0,0 +1,268 @@
+#pragma once
+
+// configs
+#include <configs/HTTP_config.h>
+#include <configs/BRICKS_config.h>
+
+// bricks
+#include <bricks/log_sink.h>
+
+// libs
+#include <Arduino.h>
+#include <Client.h>
+#include <Preferences.h>
+#include <StatusLogger.h>
+#include <TimeLib.h>
+
+// A small cache of host -> IP, so reconnecting to the same hosts doesn't cost a DNS lookup over 4G every time.
+// Entries live for DNS_CACHE_TTL_S (the modem's lookup doesn't give us the record's real TTL) and are saved to NVS,
+// so they survive a reboot. A stale entry is harmless: if a connect to a cached IP fails we look the host up again.
+namespace DNSCache
+{
+    typedef bool (*LookupFunction)(const char *host, IPAddress &ip); // asks the modem, without the cache
+
+    struct Entry
+    {
+        char host[DNS_CACHE_HOST_MAX]; // empty if the slot is free
+        uint32_t ip;
+        uint32_t expires_at; // unix time, 0 if we didn't know the time when we looked it up
+    };
+
+    Entry entries[DNS_CACHE_SIZE];
+    bool is_loaded = false;
+    Preferences store;
+
+    uint32_t hits = 0;            // connects made straight to a cached IP
+    uint32_t misses = 0;          // connects that needed a lookup first
+    uint32_t fallbacks = 0;       // connects to a cached IP that failed, so we looked it up again
+    uint32_t lookups = 0;         // lookups that got an IP
+    uint32_t lookup_failures = 0; // lookups that didn't (we let the modem resolve the host itself)
+    uint32_t lookup_ms_total = 0;
+
+    /**
+     * @brief Load the cache from NVS (once)
+     */
+    void load()
+    {
+        if (is_loaded)
+        {
+            return;
+        }
+        store.begin("dns", true);
+        if (store.getBytes("entries", entries, sizeof(entries)) != sizeof(entries))
+        // Nothing saved yet (or saved by a firmware with a different cache layout)
+        {
+            memset(entries, 0, sizeof(entries));
+        }
+        store.end();
+        is_loaded = true;
+    }
+
+    /**
+     * @brief Save the cache to NVS
+     */
+    void save()
+    {
+        store.begin("dns", false);
+        store.putBytes("entries", entries, sizeof(entries));
+        store.end();
+    }
+
+    /**
+     * @brief Find a host's entry
+     *
+     * @returns the entry, or nullptr if we don't have one
+     */
+    Entry *find(const char *host)
+    {
+        load();
+        for (Entry &entry : entries)
+        {
+            if (strncmp(entry.host, host, sizeof(entry.host)) == 0)
+            {
+                return &entry;
+            }
+        }
+        return nullptr;
+    }
+
+    /**
+     * @brief Get a host's IP from the cache, if we have one that hasn't expired
+     *
+     * @param host the host
+     * @param ip set to the cached IP
+     * @returns true if we had a fresh entry, otherwise false
+     */
+    bool getCached(const char *host, IPAddress &ip)
+    {
+        Entry *entry = find(host);
+        if (entry == nullptr)
+        {
+            return false;
+        }
+        if (timeStatus() == timeNotSet or (uint32_t)now() >= entry->expires_at)
+        // Expired, or we can't tell: we don't know the time yet, or it was looked up before we did (expires_at is 0)
+        {
+            return false;
+        }
+        ip = IPAddress(entry->ip);
+        return true;
+    }
+
+    /**
+     * @brief Look a host up (skipping the cache) and cache the answer
+     *
+     * @param lookup_function the function that asks the modem
+     * @param host the host
+     * @param ip set to the host's IP
+     * @returns true if the lookup got an IP, otherwise false
+     */
+    bool lookup(LookupFunction lookup_function, const char *host, IPAddress &ip)
+    {
+        if (strlen(host) >= DNS_CACHE_HOST_MAX)
+        // Too long to cache, let the modem resolve it when it connects
+        {
+            return false;
+        }
+        unsigned long start_time = millis();
+        if (!lookup_function(host, ip))
+        {
+            lookup_failures++;
+            LogSink::log(LogSink::LOG_WARNING, StatusLogger::NAME_SIMCOM, "DNS lookup of %s failed.", host);
+            return false;
+        }
+        lookups++;
+        lookup_ms_total += millis() - start_time;
+
+        Entry *entry = find(host);
+        if (entry == nullptr)
+        // Take a free slot, or the one closest to expiring
+        {
+            entry = &entries[0];
+            for (Entry &candidate : entries)
+            {
+                if (candidate.host[0] == '\0' or candidate.expires_at < entry->expires_at)
+                {
+                    entry = &candidate;
+                    if (candidate.host[0] == '\0')
+                    {
+                        break;
+                    }
+                }
+            }
+            strncpy(entry->host, host, sizeof(entry->host));
+        }
+        entry->ip = (uint32_t)ip;
+        entry->expires_at = timeStatus() != timeNotSet ? (uint32_t)now() + DNS_CACHE_TTL_S : 0;
+        save();
+        return true;
+    }
+
+    /**
+     * @brief Print the cache's hit rate and the DNS time it saved us (to add to our status report)
+     *
+     * @param stream the stream to print to
+     */
+    void printDNSMetrics(Stream *stream)
+    {
+        uint32_t average_lookup_ms = lookups ? lookup_ms_total / lookups : 0;
+        stream->print("DNS_CACHE: hits=");
+        stream->print(hits);
+        stream->print(", misses=");
+        stream->print(misses);
+        stream->print(", hit_rate=");
+        stream->print(hits + misses ? (float)hits / (hits + misses) : 0);
+        stream->print(", fallbacks=");
+        stream->print(fallbacks);
+        stream->print(", lookups=");
+        stream->print(lookups);
+        stream->print(", lookup_failures=");
+        stream->print(lookup_failures);
+        stream->print(", avg_lookup_ms=");
+        stream->print(average_lookup_ms);
+        stream->print(", saved_ms=");
+        stream->println(hits * average_lookup_ms);
+    }
+}
+
+/**
+ * @brief A Client wrapper that connects by IP, from the DNS cache. Put it under SSLClient: SSLClient still connects by
+ * hostname (so SNI and certificate checks use the name), and we swap the name for a cached IP on the way down.
+ */
+class ResolvingClient : public Client
+{
+public:
+    ResolvingClient(Client &client, DNSCache::LookupFunction lookup) : client(client), lookup(lookup) {}
+
+    int connect(IPAddress ip, uint16_t port) override
+    {
+        return client.connect(ip, port);
+    }
+    int connect(const char *host, uint16_t port) override
+    {
+        IPAddress ip;
+        if (DNSCache::getCached(host, ip))
+        {
+            if (client.connect(ip, port))
+            {
+                DNSCache::hits++;
+                return 1;
+            }
+            // The host may have moved, look it up again rather than trust the cache
+            DNSCache::fallbacks++;
+        }
+        else
+        {
+            DNSCache::misses++;
+        }
+        if (DNSCache::lookup(lookup, host, ip))
+        {
+            return client.connect(ip, port);
+        }
+        return client.connect(host, port); // let the modem resolve it
+    }
+    size_t write(uint8_t b) override
+    {
+        return client.write(b);
+    }
+    size_t write(const uint8_t *buf, size_t size) override
+    {
+        return client.write(buf, size);
+    }
+    int available() override
+    {
+        return client.available();
+    }
+    int read() override
+    {
+        return client.read();
+    }
+    int read(uint8_t *buf, size_t size) override
+    {
+        return client.read(buf, size);
+    }
+    int peek() override
+    {
+        return client.peek();
+    }
+    void flush() override
+    {
+        client.flush();
+    }
+    void stop() override
+    {
+        client.stop();
+    }
+    uint8_t connected() override
+    {
+        return client.connected();
+    }
+    operator bool() override
+    {
+        return (bool)client;
+    }
+
+private:
+    Client &client;
+    DNSCache::LookupFunction lookup;
+};
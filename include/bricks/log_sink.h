@@ -0,0 +1,293 @@
+#pragma once
+
+// configs
+#include <configs/OPERATIONS_config.h>
+
+// libs
+#include <Arduino.h>
+#include <stdarg.h>
+
+// An asynchronous, rate limited log pipeline. Logging on the hot path only formats a line into a preallocated ring
+// buffer, a low priority task does the slow part (writing it out at 115200 baud). If the ring is full, or a tag is
+// logging faster than its rate limit, the line is dropped and counted rather than blocking the caller.
+namespace LogSink
+{
+    enum LOG_LEVEL_ENUM
+    {
+        LOG_VERBOSE,
+        LOG_GOOD_NEWS,
+        LOG_WARNING,
+        LOG_ERROR,
+    };
+    const char *LEVEL_NAMES[] = {"VERBOSE", "GOOD_NEWS", "WARNING", "ERROR"};
+
+    struct TagBucket
+    {
+        char tag[16];
+        uint8_t tokens;
+        unsigned long last_refill; // millis()
+        uint32_t suppressed;       // lines dropped since the tag's last logged line
+    };
+
+    char ring[LOG_BUFFER_SIZE];
+    uint32_t ring_head = 0; // byte offsets, only ever increase (wrapped with % LOG_BUFFER_SIZE)
+    uint32_t ring_tail = 0;
+    portMUX_TYPE ring_lock = portMUX_INITIALIZER_UNLOCKED;
+    TagBucket buckets[LOG_MAX_TAGS];
+    uint8_t bucket_count = 0;
+    TaskHandle_t drain_task = nullptr;
+
+    uint32_t lines_written = 0;
+    uint32_t lines_dropped_full = 0;
+    uint32_t lines_rate_limited = 0;
+    uint32_t ring_high_water = 0;
+
+    /**
+     * @brief Take a token from a tag's bucket (call with ring_lock held)
+     *
+     * @param tag the tag that wants to log
+     * @param suppressed set to the number of lines this tag had dropped since it last logged
+     * @returns true if the tag may log, otherwise false
+     */
+    bool takeToken(const char *tag, uint32_t &suppressed)
+    {
+        TagBucket *bucket = nullptr;
+        for (uint8_t i = 0; i < bucket_count; i++)
+        {
+            if (strncmp(buckets[i].tag, tag, sizeof(buckets[i].tag) - 1) == 0)
+            {
+                bucket = &buckets[i];
+                break;
+            }
+        }
+        if (bucket == nullptr)
+        {
+            bucket = &buckets[bucket_count < LOG_MAX_TAGS ? bucket_count++ : LOG_MAX_TAGS - 1];
+            strncpy(bucket->tag, tag, sizeof(bucket->tag) - 1);
+            bucket->tag[sizeof(bucket->tag) - 1] = '\0';
+            bucket->tokens = LOG_RATE_BURST;
+            bucket->last_refill = millis();
+            bucket->suppressed = 0;
+        }
+
+        unsigned long refills = (millis() - bucket->last_refill) / LOG_RATE_REFILL_MS;
+        if (refills)
+        {
+            bucket->tokens = min((unsigned long)LOG_RATE_BURST, bucket->tokens + refills);
+            bucket->last_refill += refills * LOG_RATE_REFILL_MS;
+        }
+        if (bucket->tokens == 0)
+        {
+            bucket->suppressed++;
+            lines_rate_limited++;
+            return false;
+        }
+        bucket->tokens--;
+        suppressed = bucket->suppressed;
+        bucket->suppressed = 0;
+        return true;
+    }
+
+    /**
+     * @brief Copy a formatted line into the ring (call with ring_lock held)
+     *
+     * @param line the line
+     * @param length the number of bytes in line
+     * @returns true if it fit, otherwise false
+     */
+    bool enqueue(const char *line, uint16_t length)
+    {
+        uint32_t needed = sizeof(length) + length;
+        if (LOG_BUFFER_SIZE - (ring_head - ring_tail) < needed)
+        {
+            lines_dropped_full++;
+            return false;
+        }
+        const char *sources[] = {(const char *)&length, line};
+        const uint32_t lengths[] = {sizeof(length), length};
+        for (int part = 0; part < 2; part++)
+        {
+            for (uint32_t i = 0; i < lengths[part]; i++)
+            {
+                ring[(ring_head + i) % LOG_BUFFER_SIZE] = sources[part][i];
+            }
+            ring_head += lengths[part];
+        }
+        if (ring_head - ring_tail > ring_high_water)
+        {
+            ring_high_water = ring_head - ring_tail;
+        }
+        return true;
+    }
+
+    /**
+     * @brief Queue a finished line and wake the drain task
+     *
+     * @param line the line (including its newline)
+     * @param length the number of bytes in line
+     */
+    void submit(const char *line, size_t length)
+    {
+        portENTER_CRITICAL(&ring_lock);
+        enqueue(line, length);
+        portEXIT_CRITICAL(&ring_lock);
+        if (drain_task != nullptr)
+        {
+            xTaskNotifyGive(drain_task);
+        }
+    }
+
+    /**
+     * @brief Check the tag's rate limit before we spend any time formatting
+     *
+     * @param tag the tag that wants to log
+     * @param suppressed set to the number of lines this tag had dropped since it last logged
+     * @returns true if the tag may log, otherwise false
+     */
+    bool allowed(const char *tag, uint32_t &suppressed)
+    {
+        portENTER_CRITICAL(&ring_lock);
+        bool allowed = takeToken(tag, suppressed);
+        portEXIT_CRITICAL(&ring_lock);
+        return allowed;
+    }
+
+    /**
+     * @brief Format the "[millis][LEVEL][TAG] " prefix of a line
+     *
+     * @returns the number of bytes written to line
+     */
+    size_t writePrefix(char *line, size_t size, LOG_LEVEL_ENUM level, const char *tag, uint32_t suppressed)
+    {
+        int written = suppressed ? snprintf(line, size, "[%lu][%s][%s] (%lu lines suppressed) ", millis(), LEVEL_NAMES[level], tag, (unsigned long)suppressed)
+                                 : snprintf(line, size, "[%lu][%s][%s] ", millis(), LEVEL_NAMES[level], tag);
+        return written < 0 ? 0 : min((size_t)written, size - 1);
+    }
+
+    /**
+     * @brief Log a printf style line. Never blocks, the line is written out later by the drain task.
+     *
+     * @param level how bad is it
+     * @param tag the brick the line is about (one of the StatusLogger names)
+     * @param format printf style format string
+     */
+    void log(LOG_LEVEL_ENUM level, const String &tag, const char *format, ...)
+    {
+        uint32_t suppressed = 0;
+        if (!allowed(tag.c_str(), suppressed))
+        {
+            return;
+        }
+        char line[LOG_LINE_MAX];
+        size_t length = writePrefix(line, sizeof(line) - 1, level, tag.c_str(), suppressed);
+
+        va_list args;
+        va_start(args, format);
+        int written = vsnprintf(line + length, sizeof(line) - 1 - length, format, args);
+        va_end(args);
+        if (written > 0)
+        {
+            length = min(length + written, sizeof(line) - 2);
+        }
+        line[length++] = '\n';
+        submit(line, length);
+    }
+
+    /**
+     * @brief Log (the start of) a request or response body, capped at LOG_BODY_DUMP_MAX bytes
+     *
+     * @param level how bad is it
+     * @param tag the brick the line is about (one of the StatusLogger names)
+     * @param label what the body is, e.g. "You will be POSTing this: "
+     * @param body the body (doesn't need to be null terminated)
+     * @param body_length the number of bytes in body
+     */
+    void logBody(LOG_LEVEL_ENUM level, const String &tag, const char *label, const char *body, size_t body_length)
+    {
+        uint32_t suppressed = 0;
+        if (!allowed(tag.c_str(), suppressed))
+        {
+            return;
+        }
+        char line[LOG_LINE_MAX + LOG_BODY_DUMP_MAX];
+        size_t length = writePrefix(line, LOG_LINE_MAX, level, tag.c_str(), suppressed);
+        size_t label_length = min(strlen(label), LOG_LINE_MAX - 1 - length);
+        memcpy(line + length, label, label_length);
+        length += label_length;
+
+        size_t dumped = min(body_length, (size_t)LOG_BODY_DUMP_MAX);
+        memcpy(line + length, body, dumped);
+        length += dumped;
+        if (dumped < body_length)
+        {
+            int written = snprintf(line + length, sizeof(line) - length - 1, "... (%lu more bytes)", (unsigned long)(body_length - dumped));
+            length = min(length + (written > 0 ? written : 0), sizeof(line) - 2);
+        }
+        line[length++] = '\n';
+        submit(line, length);
+    }
+
+    /**
+     * @brief The drain task: writes queued lines out to Serial, whenever there's nothing more important to do
+     */
+    void drainTask(void *)
+    {
+        char line[LOG_LINE_MAX + LOG_BODY_DUMP_MAX];
+        while (true)
+        {
+            uint16_t length = 0;
+            portENTER_CRITICAL(&ring_lock);
+            if (ring_head != ring_tail)
+            {
+                for (uint32_t i = 0; i < sizeof(length); i++)
+                {
+                    ((char *)&length)[i] = ring[(ring_tail + i) % LOG_BUFFER_SIZE];
+                }
+                for (uint32_t i = 0; i < length; i++)
+                {
+                    line[i] = ring[(ring_tail + sizeof(length) + i) % LOG_BUFFER_SIZE];
+                }
+                ring_tail += sizeof(length) + length;
+            }
+            portEXIT_CRITICAL(&ring_lock);
+
+            if (length == 0)
+            {
+                ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(100));
+                continue;
+            }
+            Serial.write((const uint8_t *)line, length);
+            lines_written++;
+        }
+    }
+
+    /**
+     * @brief Start the drain task (call after Serial.begin). Lines logged before this are kept until it starts.
+     */
+    void begin()
+    {
+        if (drain_task == nullptr)
+        {
+            xTaskCreatePinnedToCore(drainTask, "log_sink", 3072, nullptr, LOG_TASK_PRIORITY, &drain_task, LOG_TASK_CORE);
+        }
+    }
+
+    /**
+     * @brief Print the log pipeline's counters (to add to our status report)
+     *
+     * @param stream the stream to print to
+     */
+    void printLogMetrics(Stream *stream)
+    {
+        stream->print("LOG_SINK: written=");
+        stream->print(lines_written);
+        stream->print(", dropped_full=");
+        stream->print(lines_dropped_full);
+        stream->print(", rate_limited=");
+        stream->print(lines_rate_limited);
+        stream->print(", buffer_high_water=");
+        stream->print(ring_high_water);
+        stream->print("/");
+        stream->println(LOG_BUFFER_SIZE);
+    }
+}
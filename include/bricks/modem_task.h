@@ -0,0 +1,400 @@
+#pragma once
+
+// configs
+#include <configs/OPERATIONS_config.h>
+
+// libs
+#include <Arduino.h>
+#include <Client.h>
+
+// The modem I/O task. It's pinned to MODEM_TASK_CORE and is the only task that talks to the SIMCOM module (SerialAT_4g
+// and the TinyGsm instance): everyone else hands it a job and waits for the result. That leaves the other core, where
+// loop() runs, to BearSSL, JSON and the app, while the AT commands crawl along at serial speed over here.
+// Until begin() is called (i.e. during setup), jobs just run on whoever calls them.
+namespace ModemTask
+{
+    typedef void (*Job)(void *context);
+
+    struct Message
+    {
+        Job job;
+        void *context;
+        TaskHandle_t caller; // notified when the job is done
+    };
+
+    QueueHandle_t jobs = nullptr;
+    TaskHandle_t task = nullptr;
+
+    uint32_t jobs_run = 0;      // jobs handed to the modem task
+    uint32_t jobs_inline = 0;   // jobs run by the caller (before begin(), or from a job that was already on the modem task)
+    uint32_t max_wait_ms = 0;   // longest a caller has waited for a job (queueing + running it)
+    uint32_t total_wait_ms = 0; // summed over jobs_run
+    portMUX_TYPE counters_lock = portMUX_INITIALIZER_UNLOCKED; // the counters are written on both cores
+
+    /**
+     * @brief Check if the calling task may talk to the modem directly
+     *
+     * @returns true if we're on the modem task (or it hasn't been started yet), otherwise false
+     */
+    bool isOwner()
+    {
+        return task == nullptr or xTaskGetCurrentTaskHandle() == task;
+    }
+
+    /**
+     * @brief Run a job on the modem task, and wait for it to finish
+     *
+     * @param job the job
+     * @param context passed to the job (it can live on the caller's stack, we don't return until the job is done)
+     */
+    void call(Job job, void *context)
+    {
+        if (isOwner())
+        {
+            portENTER_CRITICAL(&counters_lock);
+            jobs_inline++;
+            portEXIT_CRITICAL(&counters_lock);
+            job(context);
+            return;
+        }
+        unsigned long start_time = millis();
+        Message message = {job, context, xTaskGetCurrentTaskHandle()};
+        xQueueSend(jobs, &message, portMAX_DELAY);
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        uint32_t wait_ms = millis() - start_time;
+        portENTER_CRITICAL(&counters_lock);
+        total_wait_ms += wait_ms;
+        max_wait_ms = max(max_wait_ms, wait_ms);
+        portEXIT_CRITICAL(&counters_lock);
+    }
+
+    /**
+     * @brief Run a function on the modem task, and return its result
+     */
+    template <typename Result>
+    Result call(Result (*function)())
+    {
+        struct Context
+        {
+            Result (*function)();
+            Result result;
+        };
+        Context context = {function, Result()};
+        call([](void *pointer)
+             { Context *context = (Context *)pointer;
+               context->result = context->function(); },
+             &context);
+        return context.result;
+    }
+
+    /**
+     * @brief Run a function with one argument on the modem task, and return its result
+     */
+    template <typename Result, typename Argument>
+    Result call(Result (*function)(Argument), Argument argument)
+    {
+        struct Context
+        {
+            Result (*function)(Argument);
+            Argument argument;
+            Result result;
+        };
+        Context context = {function, argument, Result()};
+        call([](void *pointer)
+             { Context *context = (Context *)pointer;
+               context->result = context->function(context->argument); },
+             &context);
+        return context.result;
+    }
+
+    /**
+     * @brief The modem task itself: run jobs, in order, forever
+     */
+    void run(void *)
+    {
+        Message message;
+        while (true)
+        {
+            if (xQueueReceive(jobs, &message, portMAX_DELAY) == pdTRUE)
+            {
+                message.job(message.context);
+                portENTER_CRITICAL(&counters_lock);
+                jobs_run++;
+                portEXIT_CRITICAL(&counters_lock);
+                xTaskNotifyGive(message.caller);
+            }
+        }
+    }
+
+    /**
+     * @brief Start the modem task. From here on, all modem traffic goes through it.
+     */
+    void begin()
+    {
+        if (task == nullptr)
+        {
+            jobs = xQueueCreate(MODEM_QUEUE_LENGTH, sizeof(Message));
+            xTaskCreatePinnedToCore(run, "modem_io", MODEM_TASK_STACK, nullptr, MODEM_TASK_PRIORITY, &task, MODEM_TASK_CORE);
+        }
+    }
+
+    /**
+     * @brief Print the modem task's counters (to add to our status report)
+     *
+     * @param stream the stream to print to
+     */
+    void printModemTaskMetrics(Stream *stream)
+    {
+        // Copy the counters under the lock, so they're consistent with each other, then print at leisure
+        portENTER_CRITICAL(&counters_lock);
+        uint32_t run_count = jobs_run;
+        uint32_t inline_count = jobs_inline;
+        uint32_t max_wait = max_wait_ms;
+        uint32_t total_wait = total_wait_ms;
+        portEXIT_CRITICAL(&counters_lock);
+
+        stream->print("MODEM_TASK: core=");
+        stream->print(MODEM_TASK_CORE);
+        stream->print(", jobs=");
+        stream->print(run_count);
+        stream->print(", inline=");
+        stream->print(inline_count);
+        stream->print(", avg_wait_ms=");
+        stream->print(run_count ? (float)total_wait / run_count : 0);
+        stream->print(", max_wait_ms=");
+        stream->println(max_wait);
+    }
+}
+
+/**
+ * @brief A Client wrapper that runs every call on the modem task. Put it right above the TinyGsmClient, so everything
+ * above it (SSLClient's crypto, HTTP, JSON) stays on the caller's core and only the socket I/O crosses over.
+ * Small reads are served from a MODEM_READ_AHEAD_SIZE buffer that one job fills, so HttpClient parsing headers a byte at
+ * a time doesn't cost a round trip to the other core per byte.
+ */
+class ModemClient : public Client
+{
+public:
+    ModemClient(Client &client) : client(client) {}
+
+    int connect(IPAddress ip, uint16_t port) override
+    {
+        clearReadAhead();
+        Operation operation(client, CONNECT_IP);
+        operation.ip = ip;
+        operation.port = port;
+        return perform(operation);
+    }
+    int connect(const char *host, uint16_t port) override
+    {
+        clearReadAhead();
+        Operation operation(client, CONNECT_HOST);
+        operation.host = host;
+        operation.port = port;
+        return perform(operation);
+    }
+    size_t write(uint8_t b) override
+    {
+        return write(&b, 1);
+    }
+    size_t write(const uint8_t *buf, size_t size) override
+    {
+        Operation operation(client, WRITE);
+        operation.write_buffer = buf;
+        operation.size = size;
+        return perform(operation);
+    }
+    int available() override
+    {
+        if (readAheadLength() > 0)
+        // Enough to be going on with, don't ask the modem
+        {
+            return readAheadLength();
+        }
+        Operation operation(client, AVAILABLE);
+        return perform(operation);
+    }
+    int read() override
+    {
+        if (!fillReadAhead())
+        {
+            return -1;
+        }
+        return read_ahead[read_ahead_start++];
+    }
+    int read(uint8_t *buf, size_t size) override
+    {
+        if (readAheadLength() == 0 and size >= sizeof(read_ahead))
+        // Big enough to go straight into the caller's buffer
+        {
+            Operation operation(client, READ);
+            operation.read_buffer = buf;
+            operation.size = size;
+            return perform(operation);
+        }
+        if (!fillReadAhead())
+        {
+            return -1;
+        }
+        size_t length = min(size, readAheadLength());
+        memcpy(buf, read_ahead + read_ahead_start, length);
+        read_ahead_start += length;
+        return length;
+    }
+    int peek() override
+    {
+        if (!fillReadAhead())
+        {
+            return -1;
+        }
+        return read_ahead[read_ahead_start];
+    }
+    void flush() override
+    {
+        Operation operation(client, FLUSH);
+        perform(operation);
+    }
+    void stop() override
+    {
+        clearReadAhead();
+        Operation operation(client, STOP);
+        perform(operation);
+    }
+    uint8_t connected() override
+    {
+        if (readAheadLength() > 0)
+        // Like any Client, we're connected while there's still data to read
+        {
+            return 1;
+        }
+        Operation operation(client, CONNECTED);
+        return perform(operation);
+    }
+    operator bool() override
+    {
+        Operation operation(client, IS_VALID);
+        return perform(operation);
+    }
+
+private:
+    Client &client;
+    uint8_t read_ahead[MODEM_READ_AHEAD_SIZE];
+    size_t read_ahead_start = 0;
+    size_t read_ahead_end = 0;
+
+    enum OperationType
+    {
+        CONNECT_IP,
+        CONNECT_HOST,
+        WRITE,
+        AVAILABLE,
+        READ_AVAILABLE,
+        READ,
+        FLUSH,
+        STOP,
+        CONNECTED,
+        IS_VALID,
+    };
+
+    struct Operation
+    {
+        Operation(Client &client, OperationType type) : client(client), type(type) {}
+
+        Client &client;
+        OperationType type;
+        IPAddress ip;
+        const char *host = nullptr;
+        uint16_t port = 0;
+        const uint8_t *write_buffer = nullptr;
+        uint8_t *read_buffer = nullptr;
+        size_t size = 0;
+        int result = 0;
+    };
+
+    size_t readAheadLength()
+    {
+        return read_ahead_end - read_ahead_start;
+    }
+
+    void clearReadAhead()
+    {
+        read_ahead_start = 0;
+        read_ahead_end = 0;
+    }
+
+    /**
+     * @brief Top up the read-ahead buffer with whatever the modem has, in one job (if it's empty)
+     *
+     * @returns true if there's at least a byte to read, otherwise false
+     */
+    bool fillReadAhead()
+    {
+        if (readAheadLength() > 0)
+        {
+            return true;
+        }
+        Operation operation(client, READ_AVAILABLE);
+        operation.read_buffer = read_ahead;
+        operation.size = sizeof(read_ahead);
+        int length = perform(operation);
+        read_ahead_start = 0;
+        read_ahead_end = length > 0 ? length : 0;
+        return read_ahead_end > 0;
+    }
+
+    /**
+     * @brief Run an operation on the modem task
+     *
+     * @returns the operation's result
+     */
+    int perform(Operation &operation)
+    {
+        ModemTask::call(run, &operation);
+        return operation.result;
+    }
+
+    /**
+     * @brief Do the operation on the client underneath (this is the job the modem task runs)
+     */
+    static void run(void *context)
+    {
+        Operation &operation = *(Operation *)context;
+        switch (operation.type)
+        {
+        case CONNECT_IP:
+            operation.result = operation.client.connect(operation.ip, operation.port);
+            break;
+        case CONNECT_HOST:
+            operation.result = operation.client.connect(operation.host, operation.port);
+            break;
+        case WRITE:
+            operation.result = operation.client.write(operation.write_buffer, operation.size);
+            break;
+        case AVAILABLE:
+            operation.result = operation.client.available();
+            break;
+        case READ_AVAILABLE:
+        // Only what's already there, so filling the read-ahead never waits for more
+        {
+            int available = operation.client.available();
+            operation.result = available > 0 ? operation.client.read(operation.read_buffer, min((size_t)available, operation.size)) : available;
+            break;
+        }
+        case READ:
+            operation.result = operation.client.read(operation.read_buffer, operation.size);
+            break;
+        case FLUSH:
+            operation.client.flush();
+            break;
+        case STOP:
+            operation.client.stop();
+            break;
+        case CONNECTED:
+            operation.result = operation.client.connected();
+            break;
+        case IS_VALID:
+            operation.result = (bool)operation.client;
+            break;
+        }
+    }
+};
@@ -0,0 +1,373 @@
+#pragma once
+
+// configs
+#include <configs/HTTP_config.h>
+#include <configs/BRICKS_config.h>
+
+// inits
+#include <inits/simcom_init.h>
+#include <inits/firmware_details_init.h>
+
+// libs
+#include <ArduinoJson.h>
+#include <Preferences.h>
+#include <StatusLogger.h>
+#include <esp_ota_ops.h>
+#include <esp_partition.h>
+#include <mbedtls/sha256.h>
+
+// Brick for over-the-air firmware updates. The image is streamed straight from the modem into the inactive OTA
+// partition, one Range request at a time, so RAM use is one OTA_CHUNK_SIZE buffer however big the image is.
+// Progress is saved to NVS after every range, so a dropped connection (or a reboot) resumes where we left off.
+namespace OTA
+{
+    enum OTA_STATE_ENUM
+    {
+        OTA_IDLE,        // nothing to do
+        OTA_DOWNLOADING, // a new image is being downloaded, call downloadNextRange() until it isn't
+        OTA_FAILED,      // the image didn't verify, we'll start again at the next check
+    };
+
+    const uint32_t FLASH_SECTOR_SIZE = 4096;
+
+    OTA_STATE_ENUM state = OTA_IDLE;
+    const esp_partition_t *target_partition = nullptr;
+    String target_version;
+    String target_path;
+    String target_sha256; // lowercase hex
+    uint32_t target_size = 0;
+    uint32_t written_offset = 0; // bytes of the image that are in flash (and hashed)
+
+    uint8_t chunk_buffer[OTA_CHUNK_SIZE];
+    mbedtls_sha256_context sha256_context;
+    mbedtls_sha256_context range_start_context; // sha256_context as it was at the start of the current range
+    Preferences progress;
+
+    uint32_t session_bytes = 0; // downloaded since boot
+    uint32_t session_ms = 0;    // time spent downloading since boot
+
+    /**
+     * @brief Check if a download was interrupted (by a dropped connection or a reboot) and should be resumed
+     *
+     * @returns true if there's a partial download saved in NVS
+     */
+    bool hasPendingDownload()
+    {
+        progress.begin("ota", true);
+        bool pending = progress.getUInt("offset", 0) > 0;
+        progress.end();
+        return pending;
+    }
+
+    /**
+     * @brief Save how far we've got, so we can resume after a drop or a reboot
+     */
+    void saveProgress()
+    {
+        progress.begin("ota", false);
+        progress.putString("version", target_version);
+        progress.putString("sha256", target_sha256);
+        progress.putUInt("size", target_size);
+        progress.putUInt("offset", written_offset);
+        progress.end();
+    }
+
+    /**
+     * @brief Forget any saved progress (after an update completes or fails verification)
+     */
+    void clearProgress()
+    {
+        progress.begin("ota", false);
+        progress.clear();
+        progress.end();
+    }
+
+    /**
+     * @brief Re-hash what's already in flash after a reboot, reusing the chunk buffer so RAM stays flat
+     *
+     * @returns true if the partition could be read back
+     */
+    bool rehashWrittenImage()
+    {
+        for (uint32_t offset = 0; offset < written_offset; offset += OTA_CHUNK_SIZE)
+        {
+            uint32_t length = min((uint32_t)OTA_CHUNK_SIZE, written_offset - offset);
+            if (esp_partition_read(target_partition, offset, chunk_buffer, length) != ESP_OK)
+            {
+                return false;
+            }
+            mbedtls_sha256_update_ret(&sha256_context, chunk_buffer, length);
+        }
+        return true;
+    }
+
+    /**
+     * @brief Write one chunk into the target partition, erasing each flash sector as we reach it
+     *
+     * @param length the number of bytes in chunk_buffer to write
+     * @returns true if written, otherwise false
+     */
+    bool writeChunk(size_t length)
+    {
+        if (written_offset % FLASH_SECTOR_SIZE == 0)
+        {
+            if (esp_partition_erase_range(target_partition, written_offset, FLASH_SECTOR_SIZE) != ESP_OK)
+            {
+                return false;
+            }
+        }
+        if (esp_partition_write(target_partition, written_offset, chunk_buffer, length) != ESP_OK)
+        {
+            return false;
+        }
+        mbedtls_sha256_update_ret(&sha256_context, chunk_buffer, length);
+        written_offset += length;
+        return true;
+    }
+
+    /**
+     * @brief Check the manifest for a new firmware version, and get ready to download (or resume downloading) it
+     *
+     * @returns true if there's a new image to download, otherwise false
+     */
+    bool checkForUpdate()
+    {
+        if (Firmware::firmware_version == "unknown")
+        // Without a FIRMWARE_VERSION we'd think every image was new, and update forever
+        {
+            return false;
+        }
+        if (!SIMCOMHandler::isEndpointReady(SIMCOMHandler::ota_endpoint))
+        {
+            return false;
+        }
+
+        // Step 1 - Get the manifest
+        SIMCOMHandler::OtaHTTP.beginRequest();
+        SIMCOMHandler::OtaHTTP.connectionKeepAlive();
+        if (SIMCOMHandler::OtaHTTP.get(OTA_MANIFEST_ENDPOINT) != 0)
+        {
+            SIMCOMHandler::OtaHTTP.stop();
+            SIMCOMHandler::recordFailure(SIMCOMHandler::ota_endpoint, "we were unable to connect to the OTA server...");
+            return false;
+        }
+        SIMCOMHandler::OtaHTTP.endRequest();
+        SIMCOMHandler::ota_endpoint.requests++;
+        SIMCOMHandler::OtaHTTP.flush(); // send the buffered request in one go
+        int response_status = SIMCOMHandler::OtaHTTP.responseStatusCode();
+        String response_body = SIMCOMHandler::OtaHTTP.responseBody();
+        if (response_status < 0 or response_status >= 500)
+        {
+            SIMCOMHandler::OtaHTTP.stop();
+            SIMCOMHandler::recordFailure(SIMCOMHandler::ota_endpoint, "we got no valid response from the OTA server (" + String(response_status) + ")...");
+            return false;
+        }
+        SIMCOMHandler::recordSuccess(SIMCOMHandler::ota_endpoint);
+
+        StaticJsonDocument<384> manifest;
+        if (response_status != 200 or deserializeJson(manifest, response_body))
+        {
+            StatusLogger::log(StatusLogger::LEVEL_ERROR, StatusLogger::NAME_OTA, "No valid firmware manifest.");
+            return false;
+        }
+        String version = manifest["version"].as<String>();
+        if (version == Firmware::firmware_version)
+        {
+            return false;
+        }
+
+        // Step 2 - Check the new image will fit
+        target_partition = esp_ota_get_next_update_partition(nullptr);
+        target_size = manifest["size"].as<uint32_t>();
+        if (target_partition == nullptr or target_size == 0 or target_size > target_partition->size)
+        {
+            StatusLogger::setBrickStatus(StatusLogger::NAME_OTA, StatusLogger::FUNCTIONALITY_PARTIAL, "Firmware " + version + " doesn't fit in the OTA partition.");
+            return false;
+        }
+        target_version = version;
+        target_path = manifest["path"].as<String>();
+        target_sha256 = manifest["sha256"].as<String>();
+        target_sha256.toLowerCase();
+
+        // Step 3 - Resume if we were part way through this exact image, otherwise start from scratch
+        progress.begin("ota", true);
+        bool same_image = progress.getString("version", "") == target_version and progress.getString("sha256", "") == target_sha256 and progress.getUInt("size", 0) == target_size;
+        written_offset = same_image ? progress.getUInt("offset", 0) : 0;
+        progress.end();
+
+        mbedtls_sha256_init(&sha256_context);
+        mbedtls_sha256_init(&range_start_context);
+        mbedtls_sha256_starts_ret(&sha256_context, 0); // 0 for SHA-256 (not SHA-224)
+        if (written_offset > target_size or !rehashWrittenImage())
+        {
+            written_offset = 0;
+            mbedtls_sha256_starts_ret(&sha256_context, 0);
+        }
+
+        StatusLogger::setBrickStatus(StatusLogger::NAME_OTA, StatusLogger::FUNCTIONALITY_PARTIAL, "Downloading firmware " + target_version + " from byte " + String(written_offset) + " of " + String(target_size) + ".");
+        state = OTA_DOWNLOADING;
+        return true;
+    }
+
+    /**
+     * @brief Check the hash of the complete image, and boot into it if it's good
+     */
+    void finishUpdate()
+    {
+        uint8_t digest[32];
+        mbedtls_sha256_finish_ret(&sha256_context, digest);
+        mbedtls_sha256_free(&sha256_context);
+        mbedtls_sha256_free(&range_start_context);
+
+        char digest_hex[65];
+        for (int i = 0; i < 32; i++)
+        {
+            sprintf(digest_hex + i * 2, "%02x", digest[i]);
+        }
+        clearProgress();
+
+        if (target_sha256 != digest_hex)
+        {
+            StatusLogger::setBrickStatus(StatusLogger::NAME_OTA, StatusLogger::FUNCTIONALITY_PARTIAL, "Firmware " + target_version + " failed its hash check.");
+            state = OTA_FAILED;
+            return;
+        }
+        if (esp_ota_set_boot_partition(target_partition) != ESP_OK) // also checks the image is a valid app
+        {
+            StatusLogger::setBrickStatus(StatusLogger::NAME_OTA, StatusLogger::FUNCTIONALITY_PARTIAL, "Firmware " + target_version + " isn't a valid image.");
+            state = OTA_FAILED;
+            return;
+        }
+        StatusLogger::log(StatusLogger::LEVEL_GOOD_NEWS, StatusLogger::NAME_OTA, "Firmware " + target_version + " verified, restarting into it.");
+        delay(1000);
+        ESP.restart();
+    }
+
+    /**
+     * @brief Download the next OTA_RANGE_SIZE bytes of the image into flash (one Range request).
+     * Call this once per loop while state == OTA_DOWNLOADING, so the rest of the loop keeps running between ranges.
+     *
+     * @returns true if the range was written, otherwise false (we'll resume from the last good range)
+     */
+    bool downloadNextRange()
+    {
+        if (state != OTA_DOWNLOADING or !SIMCOMHandler::isEndpointReady(SIMCOMHandler::ota_endpoint))
+        {
+            return false;
+        }
+        if (written_offset == target_size)
+        // We'd saved the last range but rebooted before checking the image, so there's nothing left to download
+        {
+            finishUpdate();
+            return true;
+        }
+        uint32_t range_end = min(written_offset + OTA_RANGE_SIZE, target_size) - 1;
+        uint32_t range_length = range_end - written_offset + 1;
+        unsigned long start_time = millis();
+
+        // Step 1 - Request the range
+        SIMCOMHandler::OtaHTTP.beginRequest();
+        SIMCOMHandler::OtaHTTP.connectionKeepAlive();
+        if (SIMCOMHandler::OtaHTTP.get(target_path) != 0)
+        {
+            SIMCOMHandler::OtaHTTP.stop();
+            SIMCOMHandler::recordFailure(SIMCOMHandler::ota_endpoint, "we were unable to connect to the OTA server...");
+            return false;
+        }
+        SIMCOMHandler::OtaHTTP.sendHeader("Range", (String("bytes=") + String(written_offset) + "-" + String(range_end)).c_str());
+        SIMCOMHandler::OtaHTTP.endRequest();
+        SIMCOMHandler::ota_endpoint.requests++;
+        SIMCOMHandler::OtaHTTP.flush(); // send the buffered request in one go
+
+        int response_status = SIMCOMHandler::OtaHTTP.responseStatusCode();
+        if (response_status != 206 and !(response_status == 200 and written_offset == 0 and range_length == target_size))
+        // 200 means the server ignored our Range header, which is only fine if the range was the whole image anyway
+        {
+            SIMCOMHandler::OtaHTTP.stop(); // the body we didn't read is still on the connection
+            SIMCOMHandler::recordFailure(SIMCOMHandler::ota_endpoint, "the OTA server didn't return our range (" + String(response_status) + ")...");
+            return false;
+        }
+        SIMCOMHandler::OtaHTTP.skipResponseHeaders();
+
+        // Step 2 - Stream it into flash, one chunk at a time
+        uint32_t range_start = written_offset;
+        mbedtls_sha256_clone(&range_start_context, &sha256_context); // so a drop can roll the hash back without re-reading flash
+        uint32_t received = 0;
+        size_t chunk_fill = 0;
+        unsigned long last_byte_time = millis();
+        while (received < range_length)
+        {
+            int available = SIMCOMHandler::OtaHTTP.available();
+            if (available <= 0)
+            {
+                if (!SIMCOMHandler::OtaHTTP.connected() or millis() - last_byte_time > 10000)
+                {
+                    break;
+                }
+                delay(10);
+                continue;
+            }
+            uint32_t wanted = min((uint32_t)(OTA_CHUNK_SIZE - chunk_fill), range_length - received);
+            int read = SIMCOMHandler::OtaHTTP.read(chunk_buffer + chunk_fill, min((uint32_t)available, wanted));
+            if (read <= 0)
+            {
+                continue;
+            }
+            last_byte_time = millis();
+            chunk_fill += read;
+            received += read;
+            if (chunk_fill == OTA_CHUNK_SIZE or received == range_length)
+            {
+                if (!writeChunk(chunk_fill))
+                {
+                    SIMCOMHandler::OtaHTTP.stop();
+                    StatusLogger::setBrickStatus(StatusLogger::NAME_OTA, StatusLogger::FUNCTIONALITY_OFFLINE, "Unable to write to the OTA partition.");
+                    state = OTA_FAILED;
+                    return false;
+                }
+                chunk_fill = 0;
+            }
+        }
+        session_bytes += received;
+        session_ms += millis() - start_time;
+
+        if (received < range_length)
+        // Dropped mid-range. Roll back to the start of the range, anything after it gets rewritten on the next attempt.
+        {
+            written_offset = range_start;
+            mbedtls_sha256_clone(&sha256_context, &range_start_context);
+            SIMCOMHandler::OtaHTTP.stop(); // the rest of the range may still arrive, so start the retry on a fresh connection
+            SIMCOMHandler::recordFailure(SIMCOMHandler::ota_endpoint, "the firmware download dropped mid-range...");
+            return false;
+        }
+        SIMCOMHandler::recordSuccess(SIMCOMHandler::ota_endpoint);
+        saveProgress();
+
+        if (written_offset == target_size)
+        {
+            finishUpdate();
+        }
+        return true;
+    }
+
+    /**
+     * @brief Print the download progress and throughput (to add to our status report)
+     *
+     * @param stream the stream to print to
+     */
+    void printOTAMetrics(Stream *stream)
+    {
+        stream->print("OTA: state=");
+        stream->print(state == OTA_IDLE ? "idle" : (state == OTA_DOWNLOADING ? "downloading" : "failed"));
+        stream->print(", version=");
+        stream->print(target_version);
+        stream->print(", offset=");
+        stream->print(written_offset);
+        stream->print("/");
+        stream->print(target_size);
+        stream->print(", downloaded=");
+        stream->print(session_bytes);
+        stream->print(", bytes_per_sec=");
+        stream->println(session_ms ? (uint32_t)((uint64_t)session_bytes * 1000 / session_ms) : 0);
+    }
+}
@@ -89,6 +89,10 @@ namespace SIMCOMHandler
      */
     bool powerDownSIMModule(bool restart = false)
     {
+        if (!ModemTask::isOwner())
+        {
+            return ModemTask::call(powerDownSIMModule, restart);
+        }
         // Close module
         attempted_initialized = false; // reset for next time
         modem.waitResponse();
@@ -113,6 +117,10 @@ namespace SIMCOMHandler
 
     SIMMODULE_STATUS_ENUM setupSIMModule()
     {
+        if (!ModemTask::isOwner())
+        {
+            return ModemTask::call(setupSIMModule);
+        }
         if (!initSIMModule())
         {
             StatusLogger::setBrickStatus(StatusLogger::NAME_SIMCOM, StatusLogger::FUNCTIONALITY_OFFLINE, "FAILED TO AT.");
@@ -134,6 +142,14 @@ namespace SIMCOMHandler
         return NO_NETWORK;
     };
 
+    /**
+     * @brief Describe the network we're on, for the status (e.g. " on Network Mode 38, and Preferred Mode 1.")
+     */
+    String describeNetwork()
+    {
+        return NetworkMode<SimcomModem>::describe(modem) + PreferredMode<SimcomModem>::describe(modem) + ".";
+    }
+
     /**
      * @brief Attempt to connect to the internet using preferred settings
      *
@@ -142,6 +158,10 @@ namespace SIMCOMHandler
      */
     SIMMODULE_STATUS_ENUM connectToInternet(bool preferLTEm = false)
     {
+        if (!ModemTask::isOwner())
+        {
+            return ModemTask::call(connectToInternet, preferLTEm);
+        }
         if (!modem.testAT())
         {
             return FAILED_TO_AT;
@@ -165,50 +185,26 @@ namespace SIMCOMHandler
         if (preferLTEm)
         {
             StatusLogger::log(StatusLogger::LEVEL_WARNING, StatusLogger::NAME_SIMCOM, "Preferring LTE-m");
-#if defined(SIM7000x) or defined(SIM7070G) or defined(SIM7600x)
-            modem.setNetworkMode(38);
-#endif
-#if defined(SIM7000x) or defined(SIM7070G)
-            modem.setPreferredMode(1); // for LTE-m
-#endif
+            NetworkMode<SimcomModem>::set(modem, NETWORK_MODE_LTE_ONLY);
+            PreferredMode<SimcomModem>::set(modem, PREFERRED_MODE_CAT_M);
         }
         else
         {
-#if defined(SIM7000x) or defined(SIM7070G) or defined(SIM7600x)
-            modem.setNetworkMode(2);
-#endif
-#if defined(SIM7000x) or defined(SIM7070G)
-            modem.setPreferredMode(3); // for LTE-m
-#endif
+            NetworkMode<SimcomModem>::set(modem, NETWORK_MODE_AUTO);
+            PreferredMode<SimcomModem>::set(modem, PREFERRED_MODE_CAT_M_AND_NB_IOT);
         }
         if (modem.gprsConnect(APN))
         {
-#if defined(SIM7000x) or defined(SIM7070G)
-            StatusLogger::setBrickStatus(StatusLogger::NAME_SIMCOM, StatusLogger::FUNCTIONALITY_FULL, "Connected on Network Mode " + String(modem.getNetworkMode()) + ", and Preferred Mode " + String(modem.getPreferredMode()));
-#elif defined(SIM7600x)
-            StatusLogger::setBrickStatus(StatusLogger::NAME_SIMCOM, StatusLogger::FUNCTIONALITY_FULL, "Connected on Network Mode " + String(modem.getNetworkMode()));
-#else
-            StatusLogger::setBrickStatus(StatusLogger::NAME_SIMCOM, StatusLogger::FUNCTIONALITY_FULL, "Connected.");
-#endif
+            StatusLogger::setBrickStatus(StatusLogger::NAME_SIMCOM, StatusLogger::FUNCTIONALITY_FULL, "Connected" + describeNetwork());
             setAvailable();
             return INTERNET_READY;
         }
         StatusLogger::log(StatusLogger::LEVEL_WARNING, StatusLogger::NAME_SIMCOM, "Setting to LTE-m mode for next attempt.");
-#if defined(SIM7000x) or defined(SIM7070G) or defined(SIM7600x)
-        modem.setNetworkMode(38);
-#endif
-#if defined(SIM7000x) or defined(SIM7070G)
-        modem.setPreferredMode(1); // for LTE-m
-#endif
+        NetworkMode<SimcomModem>::set(modem, NETWORK_MODE_LTE_ONLY);
+        PreferredMode<SimcomModem>::set(modem, PREFERRED_MODE_CAT_M);
         if (modem.gprsConnect(APN))
         { // Defined in config.h
-#if defined(SIM7000x) or defined(SIM7070G)
-            StatusLogger::setBrickStatus(StatusLogger::NAME_SIMCOM, StatusLogger::FUNCTIONALITY_FULL, "Connected on Network Mode " + String(modem.getNetworkMode()) + ", and Preferred Mode " + String(modem.getPreferredMode()));
-#elif defined(SIM7600x)
-            StatusLogger::setBrickStatus(StatusLogger::NAME_SIMCOM, StatusLogger::FUNCTIONALITY_FULL, "Connected on Network Mode " + String(modem.getNetworkMode()));
-#else
-            StatusLogger::setBrickStatus(StatusLogger::NAME_SIMCOM, StatusLogger::FUNCTIONALITY_FULL, "Connected.");
-#endif
+            StatusLogger::setBrickStatus(StatusLogger::NAME_SIMCOM, StatusLogger::FUNCTIONALITY_FULL, "Connected" + describeNetwork());
             setAvailable();
             return INTERNET_READY;
         }
@@ -224,6 +220,10 @@ namespace SIMCOMHandler
      */
     bool updateSSLTime() // set UTC to true to account for timezone
     {
+        if (!ModemTask::isOwner())
+        {
+            return ModemTask::call(updateSSLTime);
+        }
         if (!SIMCOMHandler::isInternetConnected())
         // Only works if you are connected to the internet!
         {
@@ -311,10 +311,12 @@ namespace SIMCOMHandler
         }
 
         StatusLogger::log(StatusLogger::LEVEL_VERBOSE, StatusLogger::NAME_SIMCOM, "Time being used is: " + String(true_time));
+        setTime(true_time); // so the rest of the firmware (e.g. the DNS cache's expiry) has the right time too
 
         // Set the secure client's verification times
-        SIMCOMHandler::beeceptor_client_secured.setVerificationTime(elapsedDays(true_time) + 719528UL, elapsedSecsToday(true_time));
-        SIMCOMHandler::openmeteo_client_secured.setVerificationTime(elapsedDays(true_time) + 719528UL, elapsedSecsToday(true_time));
+        SIMCOMHandler::beeceptor_stack.setVerificationTime(elapsedDays(true_time) + 719528UL, elapsedSecsToday(true_time));
+        SIMCOMHandler::openmeteo_stack.setVerificationTime(elapsedDays(true_time) + 719528UL, elapsedSecsToday(true_time));
+        SIMCOMHandler::ota_stack.setVerificationTime(elapsedDays(true_time) + 719528UL, elapsedSecsToday(true_time));
 
         is_ssl_date_updated = true;
         return true;
@@ -0,0 +1,144 @@
+#pragma once
+
+// configs
+#include <configs/OPERATIONS_config.h>
+
+// libs
+#include <Arduino.h>
+#ifdef CPU_MONITOR
+#include <esp_freertos_hooks.h>
+#endif
+
+// How close each of our tasks has come to overflowing its stack, and (with CPU_MONITOR) how busy each core is.
+// CPU use comes from the idle hooks: each core's idle task calls its hook over and over while there's nothing else to
+// run, so the hook's call rate drops as the core gets busier. We compare it to the rate measured at boot, while the
+// cores were (nearly) idle. The hooks keep the idle tasks spinning rather than sleeping until the next interrupt (so no
+// WAITI or light sleep), which is why CPU_MONITOR is off unless you're debugging.
+namespace TaskMonitor
+{
+    struct WatchedTask
+    {
+        const char *name;
+        TaskHandle_t handle;
+    };
+
+    WatchedTask watched_tasks[TASK_MONITOR_MAX_TASKS];
+    size_t watched_task_count = 0;
+
+#ifdef CPU_MONITOR
+    volatile uint32_t idle_calls[portNUM_PROCESSORS] = {};
+    uint32_t idle_calls_at_last_sample[portNUM_PROCESSORS] = {};
+    float idle_calls_per_ms_when_idle[portNUM_PROCESSORS] = {}; // the calibration
+    unsigned long last_sample_time = 0;
+
+    bool idleHookCore0()
+    {
+        idle_calls[0]++;
+        return false; // call us again straight away
+    }
+#if portNUM_PROCESSORS > 1
+    bool idleHookCore1()
+    {
+        idle_calls[1]++;
+        return false;
+    }
+#endif
+
+    /**
+     * @brief Work out each core's idle hook rate since the last sample
+     *
+     * @param rates set to the idle calls per ms of each core
+     */
+    void sampleIdleRates(float *rates)
+    {
+        unsigned long elapsed_ms = max(millis() - last_sample_time, 1UL);
+        for (int core = 0; core < portNUM_PROCESSORS; core++)
+        {
+            uint32_t calls = idle_calls[core];
+            rates[core] = (float)(calls - idle_calls_at_last_sample[core]) / elapsed_ms;
+            idle_calls_at_last_sample[core] = calls;
+        }
+        last_sample_time = millis();
+    }
+
+    /**
+     * @brief Print each core's CPU use since the last report
+     *
+     * @param stream the stream to print to
+     */
+    void printCPUMetrics(Stream *stream)
+    {
+        float rates[portNUM_PROCESSORS];
+        sampleIdleRates(rates);
+        stream->print("CPU:");
+        for (int core = 0; core < portNUM_PROCESSORS; core++)
+        {
+            if (rates[core] > idle_calls_per_ms_when_idle[core])
+            // It was even idler than at boot, so that's our new idea of idle
+            {
+                idle_calls_per_ms_when_idle[core] = rates[core];
+            }
+            float busy = idle_calls_per_ms_when_idle[core] > 0 ? 1 - rates[core] / idle_calls_per_ms_when_idle[core] : 0;
+            stream->print(core ? ", core" : " core");
+            stream->print(core);
+            stream->print("_busy=");
+            stream->print(busy * 100, 1);
+            stream->print("%");
+        }
+        stream->println();
+    }
+#endif
+
+    /**
+     * @brief Register the idle hooks and calibrate them, with CPU_MONITOR (call early in setup, before the busy work
+     * starts)
+     */
+    void begin()
+    {
+#ifdef CPU_MONITOR
+        esp_register_freertos_idle_hook_for_cpu(idleHookCore0, 0);
+#if portNUM_PROCESSORS > 1
+        esp_register_freertos_idle_hook_for_cpu(idleHookCore1, 1);
+#endif
+        sampleIdleRates(idle_calls_per_ms_when_idle);
+        delay(CPU_MONITOR_CALIBRATION_MS);
+        sampleIdleRates(idle_calls_per_ms_when_idle);
+#endif
+    }
+
+    /**
+     * @brief Add a task to the stack report
+     *
+     * @param name what to call it in the report
+     * @param handle the task (ignored if nullptr, e.g. a task that was never started)
+     */
+    void watch(const char *name, TaskHandle_t handle)
+    {
+        if (handle != nullptr and watched_task_count < TASK_MONITOR_MAX_TASKS)
+        {
+            watched_tasks[watched_task_count++] = {name, handle};
+        }
+    }
+
+    /**
+     * @brief Print each watched task's stack high water mark, and each core's CPU use since the last report with
+     * CPU_MONITOR (to add to our status report)
+     *
+     * @param stream the stream to print to
+     */
+    void printTaskMetrics(Stream *stream)
+    {
+#ifdef CPU_MONITOR
+        printCPUMetrics(stream);
+#endif
+        stream->print("TASK_STACKS (bytes never used):");
+        for (size_t i = 0; i < watched_task_count; i++)
+        {
+            stream->print(i ? ", " : " ");
+            stream->print(watched_tasks[i].name);
+            stream->print("=");
+            stream->print(uxTaskGetStackHighWaterMark(watched_tasks[i].handle));
+        }
+        stream->println();
+    }
+}
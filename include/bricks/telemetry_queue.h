@@ -0,0 +1,75 @@
+#pragma once
+
+// configs
+#include <configs/OPERATIONS_config.h>
+
+// utils
+#include <utils/spsc_ring.h>
+#include <utils/telemetry_schema.h>
+
+// libs
+#include <ArduinoJson.h>
+
+// The hand-off between whatever produces raw samples (sensor tasks, ISRs, the meteo fetch) and the aggregator, which
+// feeds the uploader. Producers only ever touch the ring, never the modem.
+namespace Telemetry
+{
+    // The one place the telemetry record is declared: X(type, name, aggregation, deadband), see utils/telemetry_schema.h
+    // The names match the keys of Open Meteo's "current_weather" object, which is what we parse them from.
+    // A sample is only sent on if a field moved by more than its deadband (see bricks/change_filter.h). time's deadband
+    // of 0 sends every new observation, raise it if your producer stamps every sample.
+#define TELEMETRY_RECORD_FIELDS(X)           \
+    X(uint32_t, time, LAST, 0)               \
+    X(float, temperature, STATS, 0.2)        \
+    X(float, windspeed, STATS, 0.5)          \
+    X(float, winddirection, STATS, 10)       /* n.b. an arithmetic mean, which doesn't know 359° is next to 0° */ \
+    X(uint16_t, weathercode, LAST, 0)        \
+    X(uint8_t, is_day, LAST, 0)
+
+    DECLARE_TELEMETRY_SCHEMA(TelemetryRecord, TELEMETRY_RECORD_FIELDS)
+
+    SPSCRing<TelemetryRecord, TELEMETRY_QUEUE_LENGTH> queue(TELEMETRY_QUEUE_POLICY);
+
+    /**
+     * @brief Queue a raw sample. Safe to call from a task other than the uploader's.
+     *
+     * @param record the record to queue
+     * @returns true if queued, false if it was dropped (see TELEMETRY_QUEUE_POLICY)
+     */
+    bool pushRecord(const TelemetryRecord &record)
+    {
+        return queue.push(record, pdMS_TO_TICKS(TELEMETRY_QUEUE_BLOCK_MS));
+    }
+
+    /**
+     * @brief Queue a raw sample from an ISR (never blocks)
+     *
+     * @param record the record to queue
+     * @returns true if queued, false if it was dropped
+     */
+    bool pushRecordFromISR(const TelemetryRecord &record)
+    {
+        return queue.pushFromISR(record);
+    }
+
+    /**
+     * @brief Print the queue's counters (to add to our status report)
+     *
+     * @param stream the stream to print to
+     */
+    void printQueueMetrics(Stream *stream)
+    {
+        stream->print("TELEMETRY_QUEUE: queued=");
+        stream->print(queue.size());
+        stream->print("/");
+        stream->print(queue.capacity());
+        stream->print(", pushed=");
+        stream->print(queue.pushedCount());
+        stream->print(", popped=");
+        stream->print(queue.poppedCount());
+        stream->print(", dropped=");
+        stream->print(queue.droppedCount());
+        stream->print(", high_water=");
+        stream->println(queue.highWater());
+    }
+}
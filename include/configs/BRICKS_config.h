@@ -8,4 +8,6 @@ namespace StatusLogger
     const String NAME_METEO = "OPEN_METEO"; // The open meteo api connection
     const String NAME_SIMCOM = "SIMCOM";     // Relevant to the SIMCOM chip
     const String NAME_ESP32 = "ESP32";     // specifically with the ESP32
+    const String NAME_OTA = "OTA";         // Firmware updates over the air
+    const String NAME_MQTT = "MQTT";       // The persistent MQTT session (when UPLOAD_TRANSPORT_MQTT)
 }
\ No newline at end of file
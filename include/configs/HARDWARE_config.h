@@ -9,7 +9,9 @@ HardwareSerial SerialAT_4g(1); // Between Arduino and Simcom board
 #define SIM_TX_pin 32
 #define SERIAL_AT_SIMCOM_BAUD 115200
 #define RESERVED_NOISE_PIN GPIO_NUM_0
-#define SIM7600x // alternatives: SIM7070G, A7672x, SIM7000x, SIM7600x
+#if !defined(SIM7070G) and !defined(A7672x) and !defined(SIM7000x) and !defined(SIM7600x)
+#define SIM7600x // alternatives: SIM7070G, A7672x, SIM7000x, SIM7600x (or pick one with -D, see the module_* envs in platformio.ini)
+#endif
 
 //-- APN SETTINGS
 const char APN[] = "em"; // Your GPRS credentials, if any
\ No newline at end of file
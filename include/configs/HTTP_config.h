@@ -3,8 +3,35 @@
 // Open Meteo endpoint
 #define OPEN_METEO_URL "api.open-meteo.com"
 #define OPEN_METEO_ENDPOINT "/v1/forecast?latitude=DEFAULT_LAT&longitude=DEFAULT_LON&hourly=temperature_2m,relativehumidity_2m,rain&current_weather=true&timeformat=unixtime"
+#define OPEN_METEO_MULTI_ENDPOINT "/v1/forecast?latitude=LATITUDES&longitude=LONGITUDES&current_weather=true&timeformat=unixtime" // no hourly, it'd be repeated for every location
+#define OPEN_METEO_MAX_LOCATIONS 16 // Most locations we'll ask for in one request (keeps the URL a sensible length)
 
 // Beeceptor endpoints
 #define BEECEPTOR_URL "sparkmate-http-test.free.beeceptor.com"
 #define DATA_ENDPOINT "/data"
-#define STATUS_ENDPOINT "/status"
\ No newline at end of file
+#define STATUS_ENDPOINT "/status"
+
+// Firmware update (OTA) endpoints
+#define OTA_URL "sparkmate-http-test.free.beeceptor.com"
+#define OTA_MANIFEST_ENDPOINT "/firmware/manifest" // returns {"version": "1.0.1", "size": 123456, "sha256": "<hex>", "path": "/firmware/1.0.1.bin"}
+#define OTA_RANGE_SIZE (16 * 1024)                 // Bytes per Range request, and how often we save our progress (a multiple of the 4 kB flash sector)
+#define OTA_CHUNK_SIZE 1024                        // Bytes buffered in RAM between the modem and flash (must divide 4 kB)
+
+// Connection resilience (applied per endpoint, see SIMCOMHandler::Endpoint)
+#define BACKOFF_BASE_MS 2000         // First retry delay after a failure (doubles for each consecutive failure)
+#define BACKOFF_MAX_MS 120000        // Ceiling for the exponential backoff
+#define BREAKER_FAILURE_THRESHOLD 5  // Consecutive failures before the circuit breaker opens
+#define BREAKER_OPEN_MS (5 * 60000)  // How long an open breaker blocks requests before we allow a trial request
+
+// Request pipelining (data and statuses written back to back on one keep-alive connection to beeceptor)
+#define PIPELINE_MAX_ATTEMPTS 3             // Connections we'll try, resending whatever hadn't been answered when one closed
+#define PIPELINE_RESPONSE_TIMEOUT_MS 15000  // How long we'll wait for each response over 4G
+
+// Write coalescing, when the module does TLS (see utils/coalescing_client.h, SSLClient buffers its own writes otherwise)
+#define COALESCE_BUFFER_SIZE 1360 // Bytes of a request we collect before passing them down (one modem send's worth)
+
+// DNS cache (see bricks/dns_cache.h)
+#define DNS_CACHE_SIZE 4             // Hosts we remember (beeceptor, open meteo, OTA, and a spare)
+#define DNS_CACHE_HOST_MAX 64        // Longest host name we'll cache
+#define DNS_CACHE_TTL_S 3600         // How long we trust a cached IP (AT+CDNSGIP doesn't tell us the record's TTL)
+#define DNS_LOOKUP_TIMEOUT_MS 15000  // How long we'll wait for the modem's lookup
@@ -0,0 +1,27 @@
+#pragma once
+
+// Upload transport. By default the data and statuses are POSTed to beeceptor, one HTTP request each.
+// With UPLOAD_TRANSPORT_MQTT they're published (QoS1) over one persistent MQTT session instead, on beeceptor's mux and
+// SSLClient, so we only pay for the TLS handshake when the session drops rather than after every refreshConnection.
+// n.b. the broker's root CA must be in the trust anchors (regenerate trust_anchors.h with pycert_bearssl)
+// #define UPLOAD_TRANSPORT_MQTT // or pass -D UPLOAD_TRANSPORT_MQTT in your build_flags
+
+// Broker. A placeholder: point it at your own broker (here, or with -D, see the release_mqtt env), and add the
+// broker's root CA to trust_anchors.h, the shipped anchors only cover beeceptor and Open Meteo.
+#ifndef MQTT_URL
+#define MQTT_URL "mqtt.example.com"
+#endif
+#ifndef MQTT_PORT
+#define MQTT_PORT 8883 // MQTT over TLS
+#endif
+#define MQTT_CLIENT_ID "sparkmate-http-test" // Must be unique per device, the broker kicks the older session otherwise
+#define MQTT_DATA_TOPIC "sparkmate-http-test/data"
+#define MQTT_STATUS_TOPIC "sparkmate-http-test/status"
+
+// Session tuning
+#define MQTT_KEEPALIVE_S 60           // Ping interval when idle. Keep it under the carrier's NAT timeout or the session silently dies
+#define MQTT_CLEAN_SESSION false      // Keep our session (and subscriptions) on the broker across reconnects
+#define MQTT_COMMAND_TIMEOUT_MS 10000 // How long we wait for a CONNACK/PUBACK over a cellular link
+#define MQTT_QOS 1                    // At least once: publish only returns true once the broker has PUBACKed
+#define MQTT_READ_BUFFER_SIZE 256     // We only ever read acks and pings
+#define MQTT_WRITE_BUFFER_SIZE 4096   // Must fit the largest message (the status report, or a full upload batch) plus its topic
@@ -9,4 +9,37 @@
 #endif
 
 // Define additional logs
-// #define DEBUG_AT_COMMANDS
\ No newline at end of file
+// #define DEBUG_AT_COMMANDS
+
+// Telemetry queue (between the producers and the uploader)
+#define TELEMETRY_QUEUE_LENGTH 64               // Raw samples held until the aggregator drains them (must be a power of two, size it for your sample rate x the longest request)
+#define TELEMETRY_QUEUE_POLICY RING_DROP_OLDEST // What to do when full: RING_DROP_OLDEST, RING_DROP_NEWEST or RING_BLOCK
+#define TELEMETRY_QUEUE_BLOCK_MS 100            // The longest a producer may wait for space (RING_BLOCK only)
+#define TELEMETRY_UPLOAD_BATCH 8                // The most aggregates we'll upload in one POST
+
+// On-device aggregation (raw samples in, one min/max/mean/last/count aggregate per window out)
+#define AGGREGATION_WINDOW_MS (60 * 1000) // Length of one aggregation window
+#define AGGREGATE_QUEUE_LENGTH 16         // Closed windows held while waiting for the uploader (must be a power of two)
+
+// Send-on-change (per-field deadbands are declared with the fields, in bricks/telemetry_queue.h)
+#define CHANGE_FILTER_HEARTBEAT_MS (15 * 60 * 1000) // Send a sample at least this often, even if nothing changed
+
+// Log sink (formatted into a ring buffer on the hot path, written out to Serial by a low priority task)
+#define LOG_BUFFER_SIZE 4096   // Bytes of formatted log lines waiting for the Serial monitor
+#define LOG_LINE_MAX 192       // Longest single log line (longer ones are truncated)
+#define LOG_BODY_DUMP_MAX 256  // Most bytes of a request/response body we'll log
+#define LOG_RATE_BURST 10      // Lines a tag may log in a burst...
+#define LOG_RATE_REFILL_MS 500 // ...then one more line every this many ms
+#define LOG_MAX_TAGS 8         // Tags we rate limit individually (any extra tags share the last slot)
+#define LOG_TASK_PRIORITY 1    // Just above idle
+#define LOG_TASK_CORE 0        // Next to the modem task, off the app core
+
+// Task placement (the modem task owns the SIMCOM module, loop() keeps the other core for TLS, JSON and the app)
+#define MODEM_TASK_CORE 0           // loop() runs on core 1
+#define MODEM_TASK_PRIORITY 3       // Above the log sink, so AT traffic isn't held up by logging
+#define MODEM_TASK_STACK 8192       // Bytes (it runs setup/connect/time sync too, which build a lot of Strings)
+#define MODEM_QUEUE_LENGTH 4        // Jobs waiting for the modem task (each caller waits for its own, so this is plenty)
+#define MODEM_READ_AHEAD_SIZE 64    // Bytes each ModemClient reads in one modem task job, so byte-by-byte reads don't cost a job each
+#define TASK_MONITOR_MAX_TASKS 4    // Tasks whose stack high water marks we report
+// #define CPU_MONITOR                 // Report each core's CPU use (the debug env sets it; the idle tasks spin instead of sleeping)
+#define CPU_MONITOR_CALIBRATION_MS 100 // How long we count idle hook calls at boot, to know what 0% busy looks like
@@ -0,0 +1,15 @@
+#pragma once
+
+// TLS profile (only applies to the SSLClient backend, the SIM7070G does TLS on the modem itself)
+//  - default: RSA trust anchors from trust_anchors.h
+//  - TLS_PROFILE_ECDSA: EC trust anchors from trust_anchors_ecdsa.h (ISRG Root X2). The servers must present an
+//    ECDSA chain, which is a fraction of the size of an RSA chain, so less to download and parse on every handshake.
+// n.b. SSLClient fixes its cipher suites and its 2048 byte I/O buffer (which already relies on max fragment length
+// negotiation) internally, so these can only be narrowed further by forking the lib into ./lib
+// #define TLS_PROFILE_ECDSA // or pass -D TLS_PROFILE_ECDSA in your build_flags (see the bench_tls_ecdsa env)
+
+#ifdef TLS_PROFILE_ECDSA
+#define TLS_PROFILE_NAME "ECDSA"
+#else
+#define TLS_PROFILE_NAME "DEFAULT"
+#endif
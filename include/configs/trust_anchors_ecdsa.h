@@ -0,0 +1,62 @@
+#ifndef _CERTIFICATES_ECDSA_H_
+#define _CERTIFICATES_ECDSA_H_
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/* This file is auto-generated by the pycert_bearssl tool.  Do not change it manually.
+ * Certificates are BearSSL br_x509_trust_anchor format.  Included certs:
+ *
+ * Index:    0
+ * Label:    ISRG Root X2
+ * Subject:  CN=ISRG Root X2,O=Internet Security Research Group,C=US
+ * Domain(s): api.open-meteo.com, sparkmate-http-test.free.beeceptor.com
+ *
+ * EC (P-384) anchors only, used by TLS_PROFILE_ECDSA (see TLS_config.h).
+ */
+
+#define TAs_NUM 1
+
+static const unsigned char TA_DN0[] = {
+    0x30, 0x4f, 0x31, 0x0b, 0x30, 0x09, 0x06, 0x03, 0x55, 0x04, 0x06, 0x13,
+    0x02, 0x55, 0x53, 0x31, 0x29, 0x30, 0x27, 0x06, 0x03, 0x55, 0x04, 0x0a,
+    0x13, 0x20, 0x49, 0x6e, 0x74, 0x65, 0x72, 0x6e, 0x65, 0x74, 0x20, 0x53,
+    0x65, 0x63, 0x75, 0x72, 0x69, 0x74, 0x79, 0x20, 0x52, 0x65, 0x73, 0x65,
+    0x61, 0x72, 0x63, 0x68, 0x20, 0x47, 0x72, 0x6f, 0x75, 0x70, 0x31, 0x15,
+    0x30, 0x13, 0x06, 0x03, 0x55, 0x04, 0x03, 0x13, 0x0c, 0x49, 0x53, 0x52,
+    0x47, 0x20, 0x52, 0x6f, 0x6f, 0x74, 0x20, 0x58, 0x32,
+};
+
+static const unsigned char TA_EC_Q0[] = {
+    0x04, 0xcd, 0x9b, 0xd5, 0x9f, 0x80, 0x83, 0x0a, 0xec, 0x09, 0x4a, 0xf3,
+    0x16, 0x4a, 0x3e, 0x5c, 0xcf, 0x77, 0xac, 0xde, 0x67, 0x05, 0x0d, 0x1d,
+    0x07, 0xb6, 0xdc, 0x16, 0xfb, 0x5a, 0x8b, 0x14, 0xdb, 0xe2, 0x71, 0x60,
+    0xc4, 0xba, 0x45, 0x95, 0x11, 0x89, 0x8e, 0xea, 0x06, 0xdf, 0xf7, 0x2a,
+    0x16, 0x1c, 0xa4, 0xb9, 0xc5, 0xc5, 0x32, 0xe0, 0x03, 0xe0, 0x1e, 0x82,
+    0x18, 0x38, 0x8b, 0xd7, 0x45, 0xd8, 0x0a, 0x6a, 0x6e, 0xe6, 0x00, 0x77,
+    0xfb, 0x02, 0x51, 0x7d, 0x22, 0xd8, 0x0a, 0x6e, 0x9a, 0x5b, 0x77, 0xdf,
+    0xf0, 0xfa, 0x41, 0xec, 0x39, 0xdc, 0x75, 0xca, 0x68, 0x07, 0x0c, 0x1f,
+    0xea,
+};
+
+static const br_x509_trust_anchor TAs[] = {
+    {
+        { (unsigned char *)TA_DN0, sizeof TA_DN0 },
+        BR_X509_TA_CA,
+        {
+            BR_KEYTYPE_EC,
+            { .ec = {
+                BR_EC_secp384r1,
+                (unsigned char *)TA_EC_Q0, sizeof TA_EC_Q0,
+            } }
+        }
+    },
+};
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif /* ifndef _CERTIFICATES_ECDSA_H_ */
\ No newline at end of file
@@ -6,6 +6,11 @@
 
 // bricks
 #include <bricks/simcom_handler.h>
+#include <bricks/aggregator.h>
+#include <bricks/log_sink.h>
+
+// utils
+#include <utils/http_pipeline.h>
 
 // libs
 #include <ArduinoJson.h>
@@ -16,143 +21,451 @@ using namespace ArduinoJson; // Needed to make ArduinoJson compile 😡
 
 namespace HTTP
 {
-    DynamicJsonDocument large_doc(32000);
-    DynamicJsonDocument small_doc(4000);
+    struct Coordinate
+    {
+        float lat;
+        float lon;
+    };
+
+    // Just the schema's fields of "current_weather", shared by every Open Meteo parse
+    typedef StaticJsonDocument<JSON_OBJECT_SIZE(1) + JSON_OBJECT_SIZE(Telemetry::TelemetryRecordSchema::FIELD_COUNT)> MeteoFilter;
+    typedef StaticJsonDocument<JSON_OBJECT_SIZE(1) + sizeof("current_weather") + Telemetry::TelemetryRecordSchema::PARSE_DOC_SIZE> MeteoDoc;
 
     /**
-     * @brief Get the Meteorological Data from the Open Meteo API
+     * @brief Send a GET to the Open Meteo API and read up to the start of the response body
      *
-     * @param lat Your latitude
-     * @param lon
-     * @returns the meteo data as a DynamicJsonDocument
+     * @param url_endpoint the path (and query) to GET
+     * @returns true if the body of a successful response is ready to be read, otherwise false
      */
-    DynamicJsonDocument getMeteorologicalData(float lat, float lon)
+    bool requestMeteorologicalData(const String &url_endpoint)
     {
-        // Step 1 - Let's reconstruct the right endpoint to use whatever Lat and Lon you want to use.
-        String url_endpoint = String(OPEN_METEO_ENDPOINT);
-        url_endpoint.replace("DEFAULT_LAT", String(lat));
-        url_endpoint.replace("DEFAULT_LON", String(lon));
+        if (!SIMCOMHandler::isEndpointReady(SIMCOMHandler::openmeteo_endpoint))
+        // We're backing off from the Open Meteo API (or its breaker is open), don't even try.
+        {
+            return false;
+        }
 
-        //  Step 2 - Send the GET request
+        //  Send the GET request
         SIMCOMHandler::OpenMeteoHTTP.beginRequest();
         SIMCOMHandler::OpenMeteoHTTP.connectionKeepAlive();
-        SIMCOMHandler::OpenMeteoHTTP.get(url_endpoint); // Check the "/ping" path at the BeeceptorHTTP. url (locked to influxdb)
+        if (SIMCOMHandler::OpenMeteoHTTP.get(url_endpoint) != 0)
+        {
+            SIMCOMHandler::recordFailure(SIMCOMHandler::openmeteo_endpoint, "we were unable to connect to the Open Meteo API...");
+            return false;
+        }
         SIMCOMHandler::OpenMeteoHTTP.endRequest();
+        SIMCOMHandler::openmeteo_endpoint.requests++;
+        SIMCOMHandler::OpenMeteoHTTP.flush(); // send the buffered request in one go
         delay(200); // Give it 200 ms for the server to respond.
 
-        // Step 3 - Get the repsonse
+        // Get the repsonse
         int response_status = SIMCOMHandler::OpenMeteoHTTP.responseStatusCode();
-        String response_body = SIMCOMHandler::OpenMeteoHTTP.responseBody();
+        if (response_status < 0 or response_status >= 500)
+        // Timed out, lost the connection, or the server is struggling
+        {
+            SIMCOMHandler::recordFailure(SIMCOMHandler::openmeteo_endpoint, "we got no valid response from the Open Meteo API (" + String(response_status) + ")...");
+        }
+        else
+        {
+            SIMCOMHandler::recordSuccess(SIMCOMHandler::openmeteo_endpoint);
+        }
         if (response_status > 300 or response_status < 200)
         {
-            StatusLogger::log(StatusLogger::LEVEL_ERROR, StatusLogger::NAME_METEO, "No valid response from the Open Meteo API.");
-            Serial.println("Response body was: ");
-            Serial.println(response_body);
-            DynamicJsonDocument error_doc(100);
-            return error_doc;
+            String response_body = SIMCOMHandler::OpenMeteoHTTP.responseBody();
+            LogSink::log(LogSink::LOG_ERROR, StatusLogger::NAME_METEO, "No valid response from the Open Meteo API (%d).", response_status);
+            LogSink::logBody(LogSink::LOG_ERROR, StatusLogger::NAME_METEO, "Response body was: ", response_body.c_str(), response_body.length());
+            return false;
         }
-        deserializeJson(large_doc, response_body);
-        return HTTP::large_doc;
+        SIMCOMHandler::OpenMeteoHTTP.skipResponseHeaders();
+        return true;
     }
 
     /**
-     * @brief Post the metereological data (or any JSON) to our data endpoint on beeceptor
-     *
-     * @param filtered_data
-     * @returns true if successfully posted, otherwise false
+     * @brief Skip whatever's left of the Open Meteo response body, so the keep-alive connection is clean for the next request
      */
-    bool postMeteorologicalData(DynamicJsonDocument filtered_data)
+    void drainMeteorologicalData()
     {
-        // Construct and check the body
-        String body;
-        serializeJson(filtered_data, body);
-
-        Serial.print("You will be POSTing this: ");
-        Serial.println(body);
-
-        // Construct into a http post request
-        SIMCOMHandler::BeeceptorHTTP.beginRequest();
-        SIMCOMHandler::BeeceptorHTTP.connectionKeepAlive();
-        if (SIMCOMHandler::BeeceptorHTTP.post(DATA_ENDPOINT) != 0)
+        unsigned long drain_start_time = millis();
+        while (!SIMCOMHandler::OpenMeteoHTTP.endOfBodyReached() and SIMCOMHandler::OpenMeteoHTTP.connected() and millis() - drain_start_time < 5000)
         {
-            return false;
+            if (SIMCOMHandler::OpenMeteoHTTP.read() < 0)
+            {
+                delay(10);
+            }
         }
-        SIMCOMHandler::BeeceptorHTTP.sendHeader("Connection", "keep-alive");
-        SIMCOMHandler::BeeceptorHTTP.sendHeader(HTTP_HEADER_CONTENT_TYPE, "application/json");
+    }
 
-        SIMCOMHandler::BeeceptorHTTP.sendHeader(HTTP_HEADER_CONTENT_LENGTH, body.length());
-        SIMCOMHandler::BeeceptorHTTP.beginBody();
-        SIMCOMHandler::BeeceptorHTTP.println(body);
-        SIMCOMHandler::BeeceptorHTTP.endRequest();
-        if (!SIMCOMHandler::beeceptor_client_secured.connected() or SIMCOMHandler::beeceptor_client_secured.getWriteError() != 0)
-        // This will happen if you lose connection in between transmissions
+    /**
+     * @brief Get the current weather from the Open Meteo API, parsed straight off the stream into a telemetry record
+     *
+     * @param lat Your latitude
+     * @param lon Your longitude
+     * @param record the record to fill with the current weather
+     * @returns true if we got the current weather, otherwise false
+     */
+    bool getMeteorologicalData(float lat, float lon, Telemetry::TelemetryRecord &record)
+    {
+        // Step 1 - Let's reconstruct the right endpoint to use whatever Lat and Lon you want to use.
+        String url_endpoint = String(OPEN_METEO_ENDPOINT);
+        url_endpoint.replace("DEFAULT_LAT", String(lat));
+        url_endpoint.replace("DEFAULT_LON", String(lon));
+
+        // Step 2 - Send the GET request and check the response
+        if (!requestMeteorologicalData(url_endpoint))
         {
-            SIMCOMHandler::refreshConnection("we were unable to POST the data to beeceptor...");
             return false;
         }
 
-        delay(200); // Give the server some time to act.
+        // Step 3 - Parse only the schema's fields of "current_weather" off the stream, the rest (e.g. hourly) is skipped as it arrives
+        MeteoFilter filter;
+        Telemetry::TelemetryRecordSchema::buildFilter(filter.createNestedObject("current_weather"));
+        MeteoDoc weather_doc;
+        DeserializationError error = deserializeJson(weather_doc, SIMCOMHandler::OpenMeteoHTTP, DeserializationOption::Filter(filter));
+        drainMeteorologicalData();
 
-        // Check if our POST was successful.
-        int response_status = SIMCOMHandler::BeeceptorHTTP.responseStatusCode();
-        String response_body = SIMCOMHandler::BeeceptorHTTP.responseBody();
-        if (response_status > 300 or response_status < 200)
+        if (error or !weather_doc.containsKey("current_weather"))
         {
-            StatusLogger::log(StatusLogger::LEVEL_ERROR, StatusLogger::NAME_BEECEPTOR, "Unable to POST data to Beeceptor...");
-            Serial.println("Response body was: ");
-            Serial.println(response_body);
+            LogSink::log(LogSink::LOG_ERROR, StatusLogger::NAME_METEO, "Unable to parse the Open Meteo response: %s", error.c_str());
             return false;
         }
-        StatusLogger::log(StatusLogger::LEVEL_GOOD_NEWS, StatusLogger::NAME_BEECEPTOR, "Successfully posted.");
+        Telemetry::TelemetryRecordSchema::fromJson(weather_doc["current_weather"], record);
         return true;
     }
 
     /**
-     * @brief Post the Device Statuses to our "status" endpoint on Beeceptor
+     * @brief Get the current weather at several locations (e.g. the waypoints of a route) in one Open Meteo request.
+     * The response is an array with one object per location, which we parse one element at a time through the same
+     * fixed-size document, so memory use doesn't grow with the number of locations.
      *
-     * @param statuses_string This could actually be any String
-     * @returns true if successfully posted, otherwise false
+     * @param locations the locations (at most OPEN_METEO_MAX_LOCATIONS)
+     * @param count the number of locations
+     * @param records filled with the current weather, records[i] for locations[i]
+     * @param is_valid set to true for each record we got the current weather for, otherwise false
+     * @returns the number of locations we got the current weather for
      */
-    bool postStatuses(String statuses_string)
+    size_t getMeteorologicalData(const Coordinate *locations, size_t count, Telemetry::TelemetryRecord *records, bool *is_valid)
     {
+        count = min(count, (size_t)OPEN_METEO_MAX_LOCATIONS);
+        for (size_t i = 0; i < count; i++)
+        {
+            is_valid[i] = false;
+        }
+        if (count == 0)
+        {
+            return 0;
+        }
 
-        Serial.print("You will be POSTing this: ");
-        Serial.println(statuses_string);
+        // Step 1 - Comma separated latitudes and longitudes, in the same order
+        String latitudes;
+        String longitudes;
+        for (size_t i = 0; i < count; i++)
+        {
+            if (i)
+            {
+                latitudes += ',';
+                longitudes += ',';
+            }
+            latitudes += String(locations[i].lat);
+            longitudes += String(locations[i].lon);
+        }
+        String url_endpoint = String(OPEN_METEO_MULTI_ENDPOINT);
+        url_endpoint.replace("LATITUDES", latitudes);
+        url_endpoint.replace("LONGITUDES", longitudes);
 
-        // Construct into a http post request
-        SIMCOMHandler::BeeceptorHTTP.beginRequest();
-        SIMCOMHandler::BeeceptorHTTP.connectionKeepAlive();
-        if (SIMCOMHandler::BeeceptorHTTP.post(STATUS_ENDPOINT) != 0)
+        // Step 2 - Send the GET request and check the response
+        if (!requestMeteorologicalData(url_endpoint))
         {
-            return false;
+            return 0;
         }
-        SIMCOMHandler::BeeceptorHTTP.sendHeader("Connection", "keep-alive");
-        SIMCOMHandler::BeeceptorHTTP.sendHeader(HTTP_HEADER_CONTENT_TYPE, "text/plain");
 
-        SIMCOMHandler::BeeceptorHTTP.sendHeader(HTTP_HEADER_CONTENT_LENGTH, statuses_string.length());
-        SIMCOMHandler::BeeceptorHTTP.beginBody();
-        SIMCOMHandler::BeeceptorHTTP.println(statuses_string);
-        SIMCOMHandler::BeeceptorHTTP.endRequest();
-        if (!SIMCOMHandler::beeceptor_client_secured.connected() or SIMCOMHandler::beeceptor_client_secured.getWriteError() != 0)
-        // This will happen if you lose connection in between transmissions
+        // Step 3 - One location gets an object back, several get an array of them: parse them one element at a time
+        MeteoFilter filter;
+        Telemetry::TelemetryRecordSchema::buildFilter(filter.createNestedObject("current_weather"));
+        MeteoDoc weather_doc;
+        size_t valid_count = 0;
+        if (count == 1 or SIMCOMHandler::OpenMeteoHTTP.find("["))
         {
-            SIMCOMHandler::refreshConnection("we were unable to POST the data to beeceptor...");
-            return false;
+            for (size_t i = 0; i < count; i++)
+            {
+                DeserializationError error = deserializeJson(weather_doc, SIMCOMHandler::OpenMeteoHTTP, DeserializationOption::Filter(filter));
+                if (error)
+                {
+                    LogSink::log(LogSink::LOG_ERROR, StatusLogger::NAME_METEO, "Unable to parse location %u of the Open Meteo response: %s", (unsigned)i, error.c_str());
+                    break;
+                }
+                if (weather_doc.containsKey("current_weather"))
+                {
+                    Telemetry::TelemetryRecordSchema::fromJson(weather_doc["current_weather"], records[i]);
+                    is_valid[i] = true;
+                    valid_count++;
+                }
+                if (i + 1 < count and !SIMCOMHandler::OpenMeteoHTTP.findUntil(",", "]"))
+                // The array ended early
+                {
+                    break;
+                }
+            }
         }
+        drainMeteorologicalData();
 
-        delay(200); // Give the server some time to act.
+        if (valid_count < count)
+        {
+            LogSink::log(LogSink::LOG_WARNING, StatusLogger::NAME_METEO, "Only got the current weather for %u of %u locations.", (unsigned)valid_count, (unsigned)count);
+        }
+        return valid_count;
+    }
 
-        // Check if our POST was successful.
-        int response_status = SIMCOMHandler::BeeceptorHTTP.responseStatusCode();
-        String response_body = SIMCOMHandler::BeeceptorHTTP.responseBody();
-        if (response_status > 300 or response_status < 200)
+    uint32_t pipelined_batches = 0; // pipelines of more than one request
+    uint32_t pipeline_resends = 0;  // requests written again because the connection closed before their response
+
+    /**
+     * @brief Post several requests to beeceptor back to back on one keep-alive connection, then read the responses in order.
+     * If the connection closes mid-pipeline, the unacknowledged requests are written again on a fresh connection.
+     * n.b. a request whose response was lost may still have reached the server, so (like any retry) a resend can duplicate it.
+     *
+     * @param requests the requests, their response_status is set as each response is read
+     * @param count the number of requests
+     * @returns the number of requests that got a response (always the first ones, as responses come back in order)
+     */
+    size_t postPipelined(HTTPPipeline::Request *requests, size_t count)
+    {
+        Client &client = SIMCOMHandler::beeceptor_stack.httpClient();
+        SIMCOMHandler::Endpoint &endpoint = SIMCOMHandler::beeceptor_endpoint;
+        size_t acknowledged = 0;
+        if (count > 1)
+        {
+            pipelined_batches++;
+        }
+        uint8_t attempt = 0;
+        for (; attempt < PIPELINE_MAX_ATTEMPTS and acknowledged < count; attempt++)
+        {
+            if (attempt == 0 and !SIMCOMHandler::isEndpointReady(endpoint))
+            // We're backing off from beeceptor (or its breaker is open), don't even try. (Our own resends are part of
+            // the same request, so they don't ask again, a half open breaker only lets one request through.)
+            {
+                break;
+            }
+            bool reused = client.connected();
+            if (!reused and !client.connect(BEECEPTOR_URL, 443))
+            {
+                SIMCOMHandler::recordFailure(endpoint, "we were unable to connect to beeceptor...");
+                break;
+            }
+            if (attempt)
+            {
+                pipeline_resends += count - acknowledged;
+            }
+
+            // Write every unacknowledged request back to back, then push them out together
+            bool written = true;
+            for (size_t i = acknowledged; i < count and written; i++)
+            {
+                written = HTTPPipeline::writeRequest(client, BEECEPTOR_URL, requests[i]);
+            }
+            client.flush();
+            if (!written or client.getWriteError() != 0)
+            {
+                if (reused)
+                // Our kept-alive connection had gone stale, try again on a fresh one
+                {
+                    SIMCOMHandler::refreshConnection(endpoint, "our keep-alive connection to beeceptor had gone stale...");
+                    continue;
+                }
+                SIMCOMHandler::recordFailure(endpoint, "we were unable to POST to beeceptor...");
+                break;
+            }
+            endpoint.requests += count - acknowledged;
+
+            // Read the responses, in the order we wrote the requests
+            size_t acknowledged_before = acknowledged;
+            bool connection_close = false;
+            while (acknowledged < count and !connection_close)
+            {
+                char preview[LOG_BODY_DUMP_MAX];
+                size_t preview_length;
+                int response_status = HTTPPipeline::readResponse(client, PIPELINE_RESPONSE_TIMEOUT_MS, connection_close, preview, sizeof(preview), preview_length);
+                if (response_status < 0)
+                {
+                    break;
+                }
+                requests[acknowledged++].response_status = response_status;
+                if (response_status > 300 or response_status < 200)
+                {
+                    LogSink::log(LogSink::LOG_ERROR, StatusLogger::NAME_BEECEPTOR, "Unable to POST to %s on beeceptor (%d)...", requests[acknowledged - 1].path, response_status);
+                    LogSink::logBody(LogSink::LOG_ERROR, StatusLogger::NAME_BEECEPTOR, "Response body was: ", preview, preview_length);
+                }
+            }
+            if (acknowledged == count)
+            {
+                if (connection_close)
+                {
+                    client.stop();
+                }
+                break;
+            }
+            if (acknowledged > acknowledged_before or reused)
+            // The server closed the connection part way (or our kept-alive one had gone stale), so the rest were never processed
+            {
+                SIMCOMHandler::refreshConnection(endpoint, "beeceptor closed the connection mid-pipeline...");
+                continue;
+            }
+            SIMCOMHandler::recordFailure(endpoint, "we got no response from beeceptor...");
+            break;
+        }
+        if (attempt == PIPELINE_MAX_ATTEMPTS and acknowledged == 0)
+        // Every attempt ended on a stale or closing connection (the loop only runs out that way), so it's still a failure
+        {
+            SIMCOMHandler::recordFailure(endpoint, "beeceptor kept closing the connection before responding...");
+            return acknowledged;
+        }
+
+        // A response (even a 4xx) means beeceptor is there, only a 5xx means it's struggling
+        for (size_t i = 0; i < acknowledged; i++)
+        {
+            if (requests[i].response_status >= 500)
+            {
+                SIMCOMHandler::recordFailure(endpoint, "beeceptor is struggling (" + String(requests[i].response_status) + ")...");
+                return acknowledged;
+            }
+        }
+        if (acknowledged)
+        {
+            SIMCOMHandler::recordSuccess(endpoint);
+        }
+        return acknowledged;
+    }
+
+    /**
+     * @brief Check if a pipelined request was posted successfully (and log it if it was)
+     *
+     * @param request the request, after postPipelined
+     * @returns true if beeceptor accepted it, otherwise false
+     */
+    bool isPosted(const HTTPPipeline::Request &request)
+    {
+        if (request.response_status > 300 or request.response_status < 200)
         {
-            StatusLogger::log(StatusLogger::LEVEL_ERROR, StatusLogger::NAME_BEECEPTOR, "Unable to POST statuses to beeceptor...");
-            Serial.println("Response body was: ");
-            Serial.println(response_body);
             return false;
         }
-        StatusLogger::log(StatusLogger::LEVEL_GOOD_NEWS, StatusLogger::NAME_BEECEPTOR, "Successfully posted.");
+        LogSink::log(LogSink::LOG_GOOD_NEWS, StatusLogger::NAME_BEECEPTOR, "Successfully posted to %s.", request.path);
         return true;
     }
-}
\ No newline at end of file
+
+    /**
+     * @brief Post a batch of aggregates and/or the statuses. When both are due they're pipelined on one keep-alive
+     * connection, so we pay for one round trip rather than two.
+     *
+     * @param windows the closed windows to post to our data endpoint
+     * @param window_count the number of windows (0 to skip the data)
+     * @param statuses_string the statuses to post to our status endpoint (empty to skip them)
+     * @param data_posted set to true if the aggregates were successfully posted, otherwise false
+     * @param statuses_posted set to true if the statuses were successfully posted, otherwise false
+     */
+    void postUploads(const Aggregation::WindowAggregate *windows, size_t window_count, const String &statuses_string, bool &data_posted, bool &statuses_posted)
+    {
+        HTTPPipeline::Request requests[2];
+        size_t count = 0;
+        size_t body_length = 0;
+        if (window_count)
+        {
+            body_length = Aggregation::encodeUploadBody(windows, window_count);
+            requests[count++] = {DATA_ENDPOINT, "application/json", Aggregation::upload_body, body_length, 0};
+            LogSink::logBody(LogSink::LOG_VERBOSE, StatusLogger::NAME_BEECEPTOR, "You will be POSTing this: ", Aggregation::upload_body, body_length);
+        }
+        if (statuses_string.length())
+        {
+            requests[count++] = {STATUS_ENDPOINT, "text/plain", statuses_string.c_str(), statuses_string.length(), 0};
+            LogSink::logBody(LogSink::LOG_VERBOSE, StatusLogger::NAME_BEECEPTOR, "You will be POSTing this: ", statuses_string.c_str(), statuses_string.length());
+        }
+        data_posted = false;
+        statuses_posted = false;
+        if (count == 0)
+        {
+            return;
+        }
+
+        postPipelined(requests, count);
+        size_t i = 0;
+        if (window_count)
+        {
+            data_posted = isPosted(requests[i++]);
+            if (data_posted)
+            {
+                Aggregation::aggregates_uploaded += window_count;
+                Aggregation::aggregate_bytes_total += body_length;
+            }
+        }
+        if (statuses_string.length())
+        {
+            statuses_posted = isPosted(requests[i++]);
+        }
+    }
+
+    /**
+     * @brief Post a JSON body to our data endpoint on beeceptor
+     *
+     * @param body the JSON body (doesn't need to be null terminated)
+     * @param body_length the number of bytes in body
+     * @returns true if successfully posted, otherwise false
+     */
+    bool postDataBody(const char *body, size_t body_length)
+    {
+        LogSink::logBody(LogSink::LOG_VERBOSE, StatusLogger::NAME_BEECEPTOR, "You will be POSTing this: ", body, body_length);
+        HTTPPipeline::Request request = {DATA_ENDPOINT, "application/json", body, body_length, 0};
+        postPipelined(&request, 1);
+        return isPosted(request);
+    }
+
+    /**
+     * @brief Post the metereological data (or any JSON) to our data endpoint on beeceptor
+     *
+     * @param filtered_data
+     * @returns true if successfully posted, otherwise false
+     */
+    bool postMeteorologicalData(DynamicJsonDocument filtered_data)
+    {
+        String body;
+        serializeJson(filtered_data, body);
+        return postDataBody(body.c_str(), body.length());
+    }
+
+    /**
+     * @brief Post a batch of windowed aggregates (as a JSON array) to our data endpoint on beeceptor
+     *
+     * @param windows the closed windows to post
+     * @param count the number of windows
+     * @returns true if successfully posted, otherwise false
+     */
+    bool postAggregates(const Aggregation::WindowAggregate *windows, size_t count)
+    {
+        bool data_posted, statuses_posted;
+        postUploads(windows, count, String(), data_posted, statuses_posted);
+        return data_posted;
+    }
+
+    /**
+     * @brief Post the Device Statuses to our "status" endpoint on Beeceptor
+     *
+     * @param statuses_string This could actually be any String
+     * @returns true if successfully posted, otherwise false
+     */
+    bool postStatuses(String statuses_string)
+    {
+        bool data_posted, statuses_posted;
+        postUploads(nullptr, 0, statuses_string, data_posted, statuses_posted);
+        return statuses_posted;
+    }
+
+    /**
+     * @brief Print how much pipelining we're doing (to add to our status report)
+     *
+     * @param stream the stream to print to
+     */
+    void printPipelineMetrics(Stream *stream)
+    {
+        stream->print("HTTP_PIPELINE: pipelined_batches=");
+        stream->print(pipelined_batches);
+        stream->print(", resent_requests=");
+        stream->println(pipeline_resends);
+    }
+}
@@ -4,6 +4,9 @@
 #include <configs/HARDWARE_config.h>
 #include <configs/OPERATIONS_config.h>
 
+// inits
+#include <inits/modem_traits.h>
+
 // libs
 #include <StatusLogger.h>
 
@@ -24,6 +27,7 @@ namespace Firmware
         Serial.println("Device ID: " + String(THINGNAME));
         Serial.println("Firmware version: " + firmware_version);
         Serial.println("Board version: " + hardware_version);
+        Serial.println("SIMCOM module: " + String(SimcomModem::name()));
         Serial.println("Firmware write date: " + write_date);
         Serial.println("Environment: " + String(ENVIRONMENT));
         Serial.println("-- END OF FIRMWARE DETAILS --");
@@ -0,0 +1,179 @@
+#pragma once
+
+// configs
+#include <configs/HARDWARE_config.h>
+
+// libs
+#include <Arduino.h>
+
+// What differs between the SIMCOM modules we support, in one place. Pick the module in HARDWARE_config.h (or with
+// -D in platformio.ini, see the module_* envs), and SimcomModem is that module's ModemTraits. The rest of the firmware
+// asks SimcomModem rather than checking which module it's built for, and the helpers below only instantiate the calls
+// a module actually has, so the other modules' paths aren't compiled at all.
+enum SimcomModel
+{
+    MODEL_SIM7000x,
+    MODEL_SIM7070G,
+    MODEL_SIM7600x,
+    MODEL_A7672x,
+};
+
+// TinyGSM picks its driver with the preprocessor, so this is the one #if chain left
+#if defined(SIM7070G)
+#define TINY_GSM_MODEM_SIM7070
+#define SIMCOM_MODEL MODEL_SIM7070G
+#elif defined(SIM7000x)
+#define TINY_GSM_MODEM_SIM7000 // not SIM7000SSL: we do TLS with SSLClient, and the SSL driver only has 2 sockets
+#define SIMCOM_MODEL MODEL_SIM7000x
+#elif defined(SIM7600x)
+#define TINY_GSM_MODEM_SIM7600
+#define SIMCOM_MODEL MODEL_SIM7600x
+#elif defined(A7672x)
+#define TINY_GSM_MODEM_SIM7600 // close enough for everything we use
+#define SIMCOM_MODEL MODEL_A7672x
+#else
+#error "Pick a SIMCOM module in HARDWARE_config.h"
+#endif
+
+// AT+CNMP (network mode) and AT+CMNB (preferred mode) values
+enum SimcomNetworkMode
+{
+    NETWORK_MODE_AUTO = 2,
+    NETWORK_MODE_LTE_ONLY = 38,
+};
+enum SimcomPreferredMode
+{
+    PREFERRED_MODE_CAT_M = 1,
+    PREFERRED_MODE_CAT_M_AND_NB_IOT = 3,
+};
+
+/**
+ * @brief What a SIMCOM module can do. Only the specializations below exist, so a module we haven't described won't
+ * compile.
+ *
+ * HAS_NETWORK_MODE: we can pick LTE only or automatic (AT+CNMP)
+ * HAS_PREFERRED_MODE: we can pick between LTE-M and NB-IoT (AT+CMNB)
+ * SSL_ON_MODEM: TLS is done by the module (TinyGsmClientSecure) rather than by SSLClient on the ESP32
+ * SOCKET_COUNT: sockets TinyGSM's driver gives us, i.e. its TINY_GSM_MUX_COUNT (we use 0-2, the benchmarks use 3)
+ * MAX_BAUD: the fastest the module's UART will go
+ */
+template <SimcomModel model>
+struct ModemTraits;
+
+template <>
+struct ModemTraits<MODEL_SIM7000x>
+{
+    static const char *name() { return "SIM7000x"; }
+    enum
+    {
+        HAS_NETWORK_MODE = true,
+        HAS_PREFERRED_MODE = true,
+        SSL_ON_MODEM = false,
+        SOCKET_COUNT = 8,
+        MAX_BAUD = 3686400,
+    };
+};
+
+template <>
+struct ModemTraits<MODEL_SIM7070G>
+{
+    static const char *name() { return "SIM7070G"; }
+    enum
+    {
+        HAS_NETWORK_MODE = true,
+        HAS_PREFERRED_MODE = true,
+        SSL_ON_MODEM = true,
+        SOCKET_COUNT = 12,
+        MAX_BAUD = 3686400,
+    };
+};
+
+template <>
+struct ModemTraits<MODEL_SIM7600x>
+{
+    static const char *name() { return "SIM7600x"; }
+    enum
+    {
+        HAS_NETWORK_MODE = true,
+        HAS_PREFERRED_MODE = false, // Cat-1/Cat-4, there's no LTE-M or NB-IoT to prefer
+        SSL_ON_MODEM = false,
+        SOCKET_COUNT = 10,
+        MAX_BAUD = 4000000,
+    };
+};
+
+template <>
+struct ModemTraits<MODEL_A7672x>
+{
+    static const char *name() { return "A7672x"; }
+    enum
+    {
+        HAS_NETWORK_MODE = false, // TinyGSM's SIM7600 driver doesn't manage the A7672's modes, leave them as they are
+        HAS_PREFERRED_MODE = false,
+        SSL_ON_MODEM = false,
+        SOCKET_COUNT = 10,
+        MAX_BAUD = 3686400,
+    };
+};
+
+typedef ModemTraits<SIMCOM_MODEL> SimcomModem;
+
+static_assert(SERIAL_AT_SIMCOM_BAUD <= SimcomModem::MAX_BAUD, "SERIAL_AT_SIMCOM_BAUD is faster than this module's UART goes");
+
+/**
+ * @brief Set/get the network mode, on modules that have one (a no-op on the others)
+ */
+template <typename Traits, bool has_network_mode = Traits::HAS_NETWORK_MODE>
+struct NetworkMode
+{
+    template <typename Modem>
+    static void set(Modem &, SimcomNetworkMode) {}
+    template <typename Modem>
+    static String describe(Modem &)
+    {
+        return "";
+    }
+};
+template <typename Traits>
+struct NetworkMode<Traits, true>
+{
+    template <typename Modem>
+    static void set(Modem &modem, SimcomNetworkMode mode)
+    {
+        modem.setNetworkMode(mode);
+    }
+    template <typename Modem>
+    static String describe(Modem &modem)
+    {
+        return " on Network Mode " + String(modem.getNetworkMode());
+    }
+};
+
+/**
+ * @brief Set/get the preferred mode, on modules that have one (a no-op on the others)
+ */
+template <typename Traits, bool has_preferred_mode = Traits::HAS_PREFERRED_MODE>
+struct PreferredMode
+{
+    template <typename Modem>
+    static void set(Modem &, SimcomPreferredMode) {}
+    template <typename Modem>
+    static String describe(Modem &)
+    {
+        return "";
+    }
+};
+template <typename Traits>
+struct PreferredMode<Traits, true>
+{
+    template <typename Modem>
+    static void set(Modem &modem, SimcomPreferredMode mode)
+    {
+        modem.setPreferredMode(mode);
+    }
+    template <typename Modem>
+    static String describe(Modem &modem)
+    {
+        return ", and Preferred Mode " + String(modem.getPreferredMode());
+    }
+};
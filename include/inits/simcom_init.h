@@ -3,23 +3,33 @@
 // configs
 #include <configs/HARDWARE_config.h>
 #include <configs/OPERATIONS_config.h>
+#include <configs/HTTP_config.h>
+#include <configs/BRICKS_config.h>
+#include <configs/TLS_config.h>
+#include <configs/MQTT_config.h>
+
+// bricks
+#include <bricks/log_sink.h>
+#include <bricks/dns_cache.h>
+#include <bricks/modem_task.h>
 
 // libs
 #include <ArduinoHttpClient.h> // How we handle HTTP requests
 #include <LoopbackStream.h>
 #include <StatusLogger.h>
 
-// --hardware agnosticism
-#if defined(SIM7070G)
-#define TINY_GSM_MODEM_SIM7070
-#elif defined(SIM7000x)
-#define TINY_GSM_MODEM_SIM7000SSL
-#elif defined(SIM7600x) or defined(A7672x)
-#define TINY_GSM_MODEM_SIM7600
-#endif
+// --hardware agnosticism (picks TinyGSM's driver, so it comes first)
+#include <inits/modem_traits.h>
+#define TINY_GSM_YIELD_MS 1 // Block (rather than spin) while waiting for the modem, so the modem task's core can idle
 #include <TinyGsmClient.h> // How we talk to the SIMCOM module
 #include <SSLClient.h>
+#include <utils/counting_client.h>
+#include <utils/coalescing_client.h>
+#ifdef TLS_PROFILE_ECDSA
+#include <configs/trust_anchors_ecdsa.h>
+#else
 #include <configs/trust_anchors.h>
+#endif
 #ifdef DEBUG_AT_COMMANDS
 #include <StreamDebugger.h>
 #endif
@@ -34,19 +44,166 @@ namespace SIMCOMHandler
     TinyGsm modem(SerialAT_4g);
 #endif
 
-#ifndef SIM7070G
-    TinyGsmClient beeceptor_client(modem, 0);
-    TinyGsmClient openmeteo_client(modem, 1);
-    SSLClient beeceptor_client_secured(beeceptor_client, TAs, (size_t)TAs_NUM, RESERVED_NOISE_PIN);
-    SSLClient openmeteo_client_secured(openmeteo_client, TAs, (size_t)TAs_NUM, RESERVED_NOISE_PIN);
-#else
-    TinyGsmClientSecure beeceptor_client_secured(modem, 0);
-    TinyGsmClientSecure openmeteo_client_secured(modem, 1);
+    static_assert(SimcomModem::SOCKET_COUNT == TINY_GSM_MUX_COUNT, "ModemTraits' SOCKET_COUNT must match the TinyGSM driver we compiled in");
+    static_assert(SimcomModem::SOCKET_COUNT >= 3, "We need a socket each for beeceptor, open meteo and OTA");
+
+    /**
+     * @brief Ask the modem for a host's IP (AT+CDNSGIP), without connecting to it
+     *
+     * @param host the host
+     * @param ip set to the host's IP
+     * @returns true if the modem found one, otherwise false
+     */
+    bool lookupHost(const char *host, IPAddress &ip)
+    {
+        if (!ModemTask::isOwner())
+        {
+            struct Lookup
+            {
+                const char *host;
+                IPAddress *ip;
+                bool is_found;
+            };
+            Lookup lookup = {host, &ip, false};
+            ModemTask::call([](void *context)
+                            { Lookup *lookup = (Lookup *)context;
+                              lookup->is_found = lookupHost(lookup->host, *lookup->ip); },
+                            &lookup);
+            return lookup.is_found;
+        }
+        modem.sendAT(GF("+CDNSGIP=\""), host, GF("\""));
+        if (modem.waitResponse(DNS_LOOKUP_TIMEOUT_MS, GF("+CDNSGIP: "), GFP(GSM_ERROR)) != 1)
+        // OK isn't one of our matches, so an early OK (e.g. the SIM7000's, before its +CDNSGIP URC) is read past
+        {
+            return false;
+        }
+        // 1,"<host>","<ip>" on success, 0,<error code> on failure
+        String response = modem.stream.readStringUntil('\n');
+        modem.waitResponse(100); // the OK after it (if it didn't come first)
+        int ip_start = response.lastIndexOf(",\"");
+        if (!response.startsWith("1,") or ip_start < 0)
+        {
+            return false;
+        }
+        String ip_string = response.substring(ip_start + 2, response.lastIndexOf("\""));
+        return ip.fromString(ip_string.c_str());
+    }
+
+    /**
+     * @brief One endpoint's clients. The layers depend on whether the module does TLS itself (SimcomModem::SSL_ON_MODEM),
+     * so there's a specialization for each. HttpClient sits on httpClient(), MQTT on secureClient().
+     */
+    template <typename Traits, bool ssl_on_modem = Traits::SSL_ON_MODEM>
+    struct ClientStack;
+
+    // TLS on the ESP32, top to bottom:
+    //   SSLClient -> ResolvingClient -> CountingClient -> ModemClient -> TinyGsmClient
+    // There's no coalescing client: SSLClient already collects writes in its I/O buffer, and only sends a record on
+    // flush(), when the buffer fills, or when we start reading. The counting client sits right above the modem, so it
+    // sees every TLS record and every AT+CIPSEND. The resolving client swaps the host name for a cached IP below
+    // SSLClient, so SNI still gets the name. The modem client runs the socket calls on the modem task, everything above
+    // it runs on the caller's core.
+    template <typename Traits>
+    struct ClientStack<Traits, false>
+    {
+        ClientStack(TinyGsm &modem, uint8_t mux)
+            : socket(modem, mux),
+              proxied(socket),
+              counted(proxied),
+              resolving(counted, lookupHost),
+              secured(resolving, TAs, (size_t)TAs_NUM, RESERVED_NOISE_PIN) {}
+
+        TinyGsmClient socket;
+        ModemClient proxied;
+        CountingClient counted;
+        ResolvingClient resolving;
+        SSLClient secured;
+
+        /**
+         * @brief The client HttpClient sits on
+         */
+        Client &httpClient()
+        {
+            return secured;
+        }
+
+        /**
+         * @brief The top of the TLS layer, for protocols that frame their own writes (e.g. MQTT)
+         */
+        Client &secureClient()
+        {
+            return secured;
+        }
+
+        /**
+         * @brief The coalescing client, if this stack has one
+         */
+        CoalescingClient *coalescer()
+        {
+            return nullptr;
+        }
+
+        /**
+         * @brief Set the time SSLClient checks certificates against
+         */
+        void setVerificationTime(uint32_t days, uint32_t seconds)
+        {
+            secured.setVerificationTime(days, seconds);
+        }
+    };
+
+#ifdef TINY_GSM_MODEM_HAS_SSL // Only TinyGSM's drivers that can do TLS on the modem have a TinyGsmClientSecure
+    // TLS on the modem, top to bottom:
+    //   CoalescingClient -> CountingClient -> ModemClient -> TinyGsmClientSecure
+    // Nothing above the socket buffers here, so the coalescing client is what turns HttpClient's many small writes into
+    // a few AT+CASENDs. There are no records to count. The modem also needs the host name to do TLS, so there's no DNS
+    // cache here.
+    template <typename Traits>
+    struct ClientStack<Traits, true>
+    {
+        ClientStack(TinyGsm &modem, uint8_t mux)
+            : socket(modem, mux),
+              proxied(socket),
+              counted(proxied),
+              coalesced(counted) {}
+
+        TinyGsmClientSecure socket;
+        ModemClient proxied;
+        CountingClient counted;
+        CoalescingClient coalesced;
+
+        Client &httpClient()
+        {
+            return coalesced;
+        }
+
+        Client &secureClient()
+        {
+            return counted;
+        }
+
+        CoalescingClient *coalescer()
+        {
+            return &coalesced;
+        }
+
+        void setVerificationTime(uint32_t, uint32_t)
+        // The modem checks certificates against its own clock
+        {
+        }
+    };
 #endif
+
+    ClientStack<SimcomModem> beeceptor_stack(modem, 0);
+    ClientStack<SimcomModem> openmeteo_stack(modem, 1);
+    ClientStack<SimcomModem> ota_stack(modem, 2);
+
     // Create a new HttpClient for Beeceptor for this session (it won't connect until we ask it to)
-    HttpClient BeeceptorHTTP(beeceptor_client_secured, BEECEPTOR_URL, 443); // 443 needed for SSL
+    HttpClient BeeceptorHTTP(beeceptor_stack.httpClient(), BEECEPTOR_URL, 443); // 443 needed for SSL
     // Create a new HttpClient for OpenMeteo for this session (it won't connect until we ask it to)
-    HttpClient OpenMeteoHTTP(openmeteo_client_secured, OPEN_METEO_URL, 443); // 443 needed for SSL
+    HttpClient OpenMeteoHTTP(openmeteo_stack.httpClient(), OPEN_METEO_URL, 443); // 443 needed for SSL
+    // Create a new HttpClient for firmware updates (it won't connect until we ask it to)
+    HttpClient OtaHTTP(ota_stack.httpClient(), OTA_URL, 443); // 443 needed for SSL
 
     // SETUP DATATYPES
     enum SIMMODULE_STATUS_ENUM
@@ -73,6 +230,10 @@ namespace SIMCOMHandler
      */
     bool isInternetConnected()
     {
+        if (!ModemTask::isOwner())
+        {
+            return ModemTask::call(isInternetConnected);
+        }
         return modem.isGprsConnected();
     }
 
@@ -163,9 +324,6 @@ namespace SIMCOMHandler
         String STR_CHUNK_BUFF;
         char c;
 
-#ifdef DEBUG_HTTP_BODY // We're not using the logger here because the body could be far longer than the expected msg length that the logger would allow
-        Serial.println("Body will be: ");
-#endif
         while (this_send_data_stream->available() >= ONE_CHUNK)
         {
             STR_CHUNK_BUFF = "";
@@ -174,13 +332,13 @@ namespace SIMCOMHandler
                 c = this_send_data_stream->read();
                 STR_CHUNK_BUFF.concat(c);
             }
-#ifdef DEBUG_HTTP_BODY // We're not using the logger here because the body could be far longer than the expected msg length that the logger would allow
-            Serial.print(STR_CHUNK_BUFF);
+#ifdef DEBUG_HTTP_BODY // The log sink caps the dump at LOG_BODY_DUMP_MAX bytes, so long bodies don't stall the upload
+            LogSink::logBody(LogSink::LOG_VERBOSE, StatusLogger::NAME_SIMCOM, "Body chunk: ", STR_CHUNK_BUFF.c_str(), STR_CHUNK_BUFF.length());
 #endif
             this_client->print(STR_CHUNK_BUFF);
             if (this_client->getWriteError() != 0)
             {
-                Serial.println("Matt a write error was set: " + this_client->getWriteError());
+                LogSink::log(LogSink::LOG_ERROR, StatusLogger::NAME_SIMCOM, "A write error was set: %d", this_client->getWriteError());
                 return false;
             }
         }
@@ -193,32 +351,236 @@ namespace SIMCOMHandler
         this_client->println(STR_CHUNK_BUFF);
         if (this_client->getWriteError() != 0)
         {
-            Serial.println("Matt a write error was set: " + this_client->getWriteError());
+            LogSink::log(LogSink::LOG_ERROR, StatusLogger::NAME_SIMCOM, "A write error was set: %d", this_client->getWriteError());
             return false;
         }
-#ifdef DEBUG_HTTP_BODY // We're not using the logger here because the body could be far longer than the expected msg length that the logger would allow
-        Serial.println(STR_CHUNK_BUFF);
-        Serial.println("END OF BODY");
+#ifdef DEBUG_HTTP_BODY
+        LogSink::logBody(LogSink::LOG_VERBOSE, StatusLogger::NAME_SIMCOM, "Last body chunk: ", STR_CHUNK_BUFF.c_str(), STR_CHUNK_BUFF.length());
 #endif
         debug_body_ended_with = STR_CHUNK_BUFF;
         return true;
     }
 
+    // CONNECTION HEALTH (per endpoint, so one flaky host doesn't take the other one down with it)
+    enum BREAKER_STATE_ENUM
+    {
+        BREAKER_CLOSED,    // requests flow as normal
+        BREAKER_OPEN,      // too many failures, we leave this host alone for a while
+        BREAKER_HALF_OPEN, // the open period has passed, one trial request may go through
+    };
+
+    struct Endpoint
+    {
+        String name;                     // The StatusLogger brick name for this endpoint
+        HttpClient *http;                // The HTTP client using this endpoint's mux (nullptr for the MQTT session)
+        Client *secured_client;          // The client underneath the HTTP client
+        BREAKER_STATE_ENUM breaker;      // Circuit breaker state
+        bool trial_in_flight;            // Half open and the trial request has been let through (others wait for its result)
+        unsigned long trial_started_at;  // millis() when the trial was let through
+        uint8_t consecutive_failures;    // Failures since the last success
+        unsigned long next_attempt_time; // millis() before which we back off from this endpoint
+        unsigned long breaker_opened_at; // millis() when the breaker last opened
+        unsigned long breaker_open_ms;   // Total time spent with the breaker open (excluding the current open period)
+        uint32_t reconnects;             // Number of times we've reset this endpoint's connection
+        uint32_t requests;               // Number of HTTP requests written (each pipelined request counts once)
+    };
+
+    Endpoint beeceptor_endpoint = {StatusLogger::NAME_BEECEPTOR, &BeeceptorHTTP, &beeceptor_stack.httpClient(), BREAKER_CLOSED, false, 0, 0, 0, 0, 0, 0, 0};
+    Endpoint openmeteo_endpoint = {StatusLogger::NAME_METEO, &OpenMeteoHTTP, &openmeteo_stack.httpClient(), BREAKER_CLOSED, false, 0, 0, 0, 0, 0, 0, 0};
+    Endpoint ota_endpoint = {StatusLogger::NAME_OTA, &OtaHTTP, &ota_stack.httpClient(), BREAKER_CLOSED, false, 0, 0, 0, 0, 0, 0, 0};
+#ifdef UPLOAD_TRANSPORT_MQTT
+    Endpoint mqtt_endpoint = {StatusLogger::NAME_MQTT, nullptr, &beeceptor_stack.secureClient(), BREAKER_CLOSED, false, 0, 0, 0, 0, 0, 0, 0}; // shares beeceptor's mux, which HTTP no longer uploads on
+#endif
+
     /**
-     * @brief Refresh the connection of all HTTP clients to keep things from going to 💩
+     * @brief Exponential backoff with jitter, so a fleet of devices doesn't retry in lock-step
      *
+     * @param failures the number of consecutive failures so far (1 for the first failure)
+     * @returns the number of milliseconds to wait before the next attempt
+     */
+    unsigned long backoffDelay(uint8_t failures)
+    {
+        unsigned long ceiling = BACKOFF_BASE_MS;
+        for (uint8_t i = 1; i < failures and ceiling < BACKOFF_MAX_MS; i++)
+        {
+            ceiling *= 2;
+        }
+        if (ceiling > BACKOFF_MAX_MS)
+        {
+            ceiling = BACKOFF_MAX_MS;
+        }
+        return ceiling / 2 + random(ceiling / 2 + 1); // somewhere between half and all of the ceiling
+    }
+
+    /**
+     * @brief Check if we're allowed to make a request to this endpoint right now (i.e. not backing off, breaker not open)
+     *
+     * @param endpoint the endpoint we want to make a request to
+     * @returns true if a request may be attempted, otherwise false
+     */
+    bool isEndpointReady(Endpoint &endpoint)
+    {
+        unsigned long now = millis();
+        if (endpoint.breaker == BREAKER_OPEN)
+        {
+            if (now - endpoint.breaker_opened_at < BREAKER_OPEN_MS)
+            {
+                return false;
+            }
+            endpoint.breaker = BREAKER_HALF_OPEN;
+            endpoint.breaker_open_ms += now - endpoint.breaker_opened_at;
+            endpoint.trial_in_flight = false;
+        }
+        if (endpoint.breaker == BREAKER_HALF_OPEN)
+        {
+            if (endpoint.trial_in_flight and now - endpoint.trial_started_at < BREAKER_OPEN_MS)
+            // Only the one trial, everyone else waits for its result (unless it never reported back)
+            {
+                return false;
+            }
+            endpoint.trial_in_flight = true;
+            endpoint.trial_started_at = now;
+            LogSink::log(LogSink::LOG_WARNING, endpoint.name, "Circuit breaker half open, allowing a trial request.");
+            return true;
+        }
+        return (long)(now - endpoint.next_attempt_time) >= 0;
+    }
+
+    /**
+     * @brief Refresh the connection of a single endpoint, leaving the other endpoint (and its mux) alone
+     *
+     * @param endpoint the endpoint whose connection we want to reset
      * @param reason Log a reason as to why we're refreshing the connection.
      */
-    void refreshConnection(String reason = "")
-    {
-        StatusLogger::log(StatusLogger::LEVEL_WARNING, StatusLogger::NAME_SIMCOM, "Refreshing the client because " + reason);
-        vTaskDelay(500);
-        SIMCOMHandler::BeeceptorHTTP.stop();
-        SIMCOMHandler::OpenMeteoHTTP.stop();
-        SIMCOMHandler::modem.streamClear();
-        SIMCOMHandler::beeceptor_client_secured.clearWriteError();
-        SIMCOMHandler::openmeteo_client_secured.clearWriteError();
-        vTaskDelay(1500);
+    void refreshConnection(Endpoint &endpoint, String reason = "")
+    {
+        LogSink::log(LogSink::LOG_WARNING, endpoint.name, "Refreshing the client because %s", reason.c_str());
+        if (endpoint.http != nullptr)
+        {
+            endpoint.http->stop(); // closes only this endpoint's socket on the modem
+        }
+        else
+        {
+            endpoint.secured_client->stop();
+        }
+        endpoint.secured_client->clearWriteError();
+        endpoint.reconnects++;
+    }
+
+    /**
+     * @brief Record a successful request, closing the breaker if it was open
+     *
+     * @param endpoint the endpoint the request was made to
+     */
+    void recordSuccess(Endpoint &endpoint)
+    {
+        if (endpoint.breaker != BREAKER_CLOSED)
+        {
+            LogSink::log(LogSink::LOG_GOOD_NEWS, endpoint.name, "Circuit breaker closed, the endpoint is back.");
+        }
+        endpoint.breaker = BREAKER_CLOSED;
+        endpoint.trial_in_flight = false;
+        endpoint.consecutive_failures = 0;
+        endpoint.next_attempt_time = millis();
+    }
+
+    /**
+     * @brief Record a failed request, reset that endpoint's connection, and back off (or open the breaker)
+     *
+     * @param endpoint the endpoint the request was made to
+     * @param reason Log a reason as to why the request failed.
+     */
+    void recordFailure(Endpoint &endpoint, String reason = "")
+    {
+        if (endpoint.consecutive_failures < 255)
+        {
+            endpoint.consecutive_failures++;
+        }
+        refreshConnection(endpoint, reason);
+
+        unsigned long now = millis();
+        if (endpoint.breaker == BREAKER_HALF_OPEN or endpoint.consecutive_failures >= BREAKER_FAILURE_THRESHOLD)
+        // The trial failed, or we've failed too many times in a row. Stop hammering this host.
+        {
+            endpoint.breaker = BREAKER_OPEN;
+            endpoint.trial_in_flight = false;
+            endpoint.breaker_opened_at = now;
+            StatusLogger::setBrickStatus(endpoint.name, StatusLogger::FUNCTIONALITY_OFFLINE, "Circuit breaker open after " + String(endpoint.consecutive_failures) + " consecutive failures.");
+            return;
+        }
+        endpoint.next_attempt_time = now + backoffDelay(endpoint.consecutive_failures);
+    }
+
+    /**
+     * @brief Print the reconnect counts and breaker open times of each endpoint (to add to our status report)
+     *
+     * @param stream the stream to print to
+     */
+    void printEndpointMetrics(Stream *stream)
+    {
+#ifdef UPLOAD_TRANSPORT_MQTT
+        Endpoint *endpoints[] = {&beeceptor_endpoint, &openmeteo_endpoint, &ota_endpoint, &mqtt_endpoint};
+#else
+        Endpoint *endpoints[] = {&beeceptor_endpoint, &openmeteo_endpoint, &ota_endpoint};
+#endif
+        for (Endpoint *endpoint : endpoints)
+        {
+            unsigned long open_ms = endpoint->breaker_open_ms;
+            if (endpoint->breaker == BREAKER_OPEN)
+            {
+                open_ms += millis() - endpoint->breaker_opened_at;
+            }
+            stream->print(endpoint->name);
+            stream->print(": reconnects=");
+            stream->print(endpoint->reconnects);
+            stream->print(", consecutive_failures=");
+            stream->print(endpoint->consecutive_failures);
+            stream->print(", breaker=");
+            stream->print(endpoint->breaker == BREAKER_CLOSED ? "closed" : (endpoint->breaker == BREAKER_OPEN ? "open" : "half_open"));
+            stream->print(", trial_in_flight=");
+            stream->print(endpoint->trial_in_flight);
+            stream->print(", breaker_open_ms=");
+            stream->println(open_ms);
+        }
+    }
+
+    /**
+     * @brief Print how well each HTTP endpoint's writes are batched: TLS records and modem sends per request (to add to
+     * our status report). n.b. these include the handshakes, so they're lower still on a kept-alive connection.
+     *
+     * @param stream the stream to print to
+     */
+    void printWriteMetrics(Stream *stream)
+    {
+        Endpoint *endpoints[] = {&beeceptor_endpoint, &openmeteo_endpoint, &ota_endpoint};
+        CoalescingClient *coalescers[] = {beeceptor_stack.coalescer(), openmeteo_stack.coalescer(), ota_stack.coalescer()};
+        CountingClient *counters[] = {&beeceptor_stack.counted, &openmeteo_stack.counted, &ota_stack.counted};
+        for (int i = 0; i < 3; i++)
+        {
+            uint32_t requests = endpoints[i]->requests;
+            stream->print(endpoints[i]->name);
+            stream->print(": requests=");
+            stream->print(requests);
+            if (coalescers[i] != nullptr)
+            {
+                stream->print(", writes_in=");
+                stream->print(coalescers[i]->writes);
+                stream->print(", flushes=");
+                stream->print(coalescers[i]->flushes);
+            }
+            if (!SimcomModem::SSL_ON_MODEM)
+            // TLS records only go through the counting client when SSLClient sits above it
+            {
+                stream->print(", tls_records=");
+                stream->print(counters[i]->tls_records);
+                stream->print(", records_per_request=");
+                stream->print(requests ? (float)counters[i]->tls_records / requests : 0);
+            }
+            stream->print(", modem_sends=");
+            stream->print(counters[i]->write_calls);
+            stream->print(", modem_sends_per_request=");
+            stream->println(requests ? (float)counters[i]->write_calls / requests : 0);
+        }
     }
 
     // Declare for later definition
@@ -0,0 +1,158 @@
+#pragma once
+
+// configs
+#include <configs/MQTT_config.h>
+#include <configs/BRICKS_config.h>
+
+// bricks
+#include <bricks/simcom_handler.h>
+#include <bricks/aggregator.h>
+#include <bricks/log_sink.h>
+
+// libs
+#include <StatusLogger.h>
+
+#ifdef UPLOAD_TRANSPORT_MQTT
+#include <MQTTClient.h>
+
+// The persistent alternative to HTTP for our uploads (see UPLOAD_TRANSPORT_MQTT in MQTT_config.h).
+// One MQTT session stays open on beeceptor's secured client: each message costs a PUBLISH and a PUBACK rather than a
+// request line, headers and a response, and the TLS handshake is only repeated when the session actually drops.
+namespace MQTT
+{
+    MQTTClient mqtt(MQTT_READ_BUFFER_SIZE, MQTT_WRITE_BUFFER_SIZE);
+
+    bool is_begun = false;
+    uint32_t session_connects = 0;
+    uint32_t messages_published = 0;
+    uint32_t payload_bytes_published = 0;
+    uint32_t publish_failures = 0;
+    unsigned long publish_ms_total = 0; // PUBLISH -> PUBACK, summed over messages_published
+
+    /**
+     * @brief Make sure our session is up, (re)connecting if the broker or the network dropped it
+     *
+     * @returns true if connected, otherwise false
+     */
+    bool ensureConnected()
+    {
+        if (mqtt.connected())
+        {
+            return true;
+        }
+        if (!SIMCOMHandler::isEndpointReady(SIMCOMHandler::mqtt_endpoint))
+        // We're backing off from the broker (or its breaker is open), don't even try.
+        {
+            return false;
+        }
+        if (!is_begun)
+        {
+            mqtt.begin(MQTT_URL, MQTT_PORT, SIMCOMHandler::beeceptor_stack.secureClient());
+            mqtt.setOptions(MQTT_KEEPALIVE_S, MQTT_CLEAN_SESSION, MQTT_COMMAND_TIMEOUT_MS);
+            is_begun = true;
+        }
+        if (!mqtt.connect(MQTT_CLIENT_ID))
+        {
+            LogSink::log(LogSink::LOG_ERROR, StatusLogger::NAME_MQTT, "Unable to connect to the broker (error %d, return code %d).", (int)mqtt.lastError(), (int)mqtt.returnCode());
+            SIMCOMHandler::recordFailure(SIMCOMHandler::mqtt_endpoint, "we were unable to connect to the MQTT broker...");
+            return false;
+        }
+        session_connects++;
+        LogSink::log(LogSink::LOG_GOOD_NEWS, StatusLogger::NAME_MQTT, "Session connected (%lu so far).", (unsigned long)session_connects);
+        return true;
+    }
+
+    /**
+     * @brief Service the session (keepalive pings, incoming acks). Call this every loop.
+     */
+    void loop()
+    {
+        if (is_begun and mqtt.connected() and !mqtt.loop())
+        {
+            SIMCOMHandler::recordFailure(SIMCOMHandler::mqtt_endpoint, "the MQTT session dropped...");
+        }
+    }
+
+    /**
+     * @brief Publish one message at QoS1, i.e. only return once the broker has acknowledged it
+     *
+     * @param topic the topic to publish to
+     * @param payload the payload (doesn't need to be null terminated)
+     * @param length the number of bytes in payload
+     * @returns true if the broker PUBACKed it, otherwise false
+     */
+    bool publish(const char *topic, const char *payload, size_t length)
+    {
+        if (!ensureConnected())
+        {
+            publish_failures++;
+            return false;
+        }
+        LogSink::logBody(LogSink::LOG_VERBOSE, StatusLogger::NAME_MQTT, "You will be publishing this: ", payload, length);
+
+        unsigned long start_time = millis();
+        if (!mqtt.publish(topic, payload, (int)length, false, MQTT_QOS))
+        {
+            publish_failures++;
+            SIMCOMHandler::recordFailure(SIMCOMHandler::mqtt_endpoint, "the broker didn't acknowledge our message...");
+            return false;
+        }
+        publish_ms_total += millis() - start_time;
+        messages_published++;
+        payload_bytes_published += length;
+        SIMCOMHandler::recordSuccess(SIMCOMHandler::mqtt_endpoint);
+        return true;
+    }
+
+    /**
+     * @brief Publish a batch of windowed aggregates (as a JSON array) to our data topic
+     *
+     * @param windows the closed windows to publish
+     * @param count the number of windows
+     * @returns true if the broker acknowledged it, otherwise false
+     */
+    bool publishAggregates(const Aggregation::WindowAggregate *windows, size_t count)
+    {
+        size_t body_length = Aggregation::encodeUploadBody(windows, count);
+        if (!publish(MQTT_DATA_TOPIC, Aggregation::upload_body, body_length))
+        {
+            return false;
+        }
+        Aggregation::aggregates_uploaded += count;
+        Aggregation::aggregate_bytes_total += body_length;
+        return true;
+    }
+
+    /**
+     * @brief Publish the Device Statuses to our status topic
+     *
+     * @param statuses_string This could actually be any String
+     * @returns true if the broker acknowledged it, otherwise false
+     */
+    bool publishStatuses(const String &statuses_string)
+    {
+        return publish(MQTT_STATUS_TOPIC, statuses_string.c_str(), statuses_string.length());
+    }
+
+    /**
+     * @brief Print the session's counters (to add to our status report)
+     *
+     * @param stream the stream to print to
+     */
+    void printMQTTMetrics(Stream *stream)
+    {
+        stream->print("MQTT: connected=");
+        stream->print(mqtt.connected());
+        stream->print(", session_connects=");
+        stream->print(session_connects);
+        stream->print(", published=");
+        stream->print(messages_published);
+        stream->print(", payload_bytes=");
+        stream->print(payload_bytes_published);
+        stream->print(", failures=");
+        stream->print(publish_failures);
+        stream->print(", avg_puback_ms=");
+        stream->println(messages_published ? publish_ms_total / messages_published : 0);
+    }
+}
+#endif
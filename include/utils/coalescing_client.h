@@ -0,0 +1,140 @@
+#pragma once
+
+// configs
+#include <configs/HTTP_config.h>
+
+// libs
+#include <Arduino.h>
+#include <Client.h>
+
+/**
+ * @brief A Client wrapper that collects small writes (the request line, each header, the body) into one buffer, and only
+ * passes them down when it's full, when flush() is called, or when we start reading the response. Put it under
+ * HttpClient so a request goes out as a few full-size writes (i.e. full TLS records and few AT+CIPSENDs) rather than
+ * one per sendHeader/print.
+ */
+class CoalescingClient : public Client
+{
+public:
+    CoalescingClient(Client &client) : client(client) {}
+
+    uint32_t writes = 0;  // write calls we took
+    uint32_t flushes = 0; // times we passed the buffer down
+
+    int connect(IPAddress ip, uint16_t port) override
+    {
+        buffered = 0;
+        return client.connect(ip, port);
+    }
+    int connect(const char *host, uint16_t port) override
+    {
+        buffered = 0;
+        return client.connect(host, port);
+    }
+    size_t write(uint8_t b) override
+    {
+        return write(&b, 1);
+    }
+    size_t write(const uint8_t *buf, size_t size) override
+    {
+        writes++;
+        size_t written = 0;
+        while (written < size)
+        {
+            if (buffered == sizeof(buffer) and !passDown())
+            {
+                break;
+            }
+            size_t length = min(size - written, sizeof(buffer) - buffered);
+            memcpy(buffer + buffered, buf + written, length);
+            buffered += length;
+            written += length;
+        }
+        return written;
+    }
+
+    /**
+     * @brief Pass whatever's buffered down (call this at the end of a request, e.g. after HttpClient::endRequest())
+     */
+    void flush() override
+    {
+        if (!flushPending())
+        {
+            client.flush();
+        }
+    }
+    int available() override
+    {
+        flushPending(); // the server can't answer a request it hasn't got
+        return client.available();
+    }
+    int read() override
+    {
+        flushPending();
+        return client.read();
+    }
+    int read(uint8_t *buf, size_t size) override
+    {
+        flushPending();
+        return client.read(buf, size);
+    }
+    int peek() override
+    {
+        flushPending();
+        return client.peek();
+    }
+    void stop() override
+    {
+        buffered = 0;
+        client.stop();
+        client.clearWriteError();
+        clearWriteError();
+    }
+    uint8_t connected() override
+    {
+        return client.connected();
+    }
+    operator bool() override
+    {
+        return (bool)client;
+    }
+
+private:
+    Client &client;
+    uint8_t buffer[COALESCE_BUFFER_SIZE];
+    size_t buffered = 0;
+
+    /**
+     * @brief End the request: pass anything buffered down, and have the client underneath send it now
+     *
+     * @returns true if there was anything to send, otherwise false
+     */
+    bool flushPending()
+    {
+        if (buffered == 0)
+        {
+            return false;
+        }
+        passDown();
+        client.flush();
+        return true;
+    }
+
+    /**
+     * @brief Write the whole buffer to the client underneath, in one call
+     *
+     * @returns true if it took all of it, otherwise false (and our write error is set)
+     */
+    bool passDown()
+    {
+        flushes++;
+        size_t written = client.write(buffer, buffered);
+        bool is_complete = written == buffered;
+        buffered = 0;
+        if (!is_complete)
+        {
+            setWriteError();
+        }
+        return is_complete;
+    }
+};
@@ -0,0 +1,133 @@
+#pragma once
+
+// libs
+#include <Arduino.h>
+#include <Client.h>
+
+/**
+ * @brief A transparent Client wrapper that counts what goes through it. Put it between a TinyGsmClient and whatever
+ * sits on top (e.g. SSLClient) to count the bytes that actually go over the air (TLS records included, IP/TCP headers
+ * not), the writes to the modem (one AT+CIPSEND each), and the TLS records we send.
+ */
+class CountingClient : public Client
+{
+public:
+    CountingClient(Client &client) : client(client) {}
+
+    uint32_t bytes_written = 0;
+    uint32_t bytes_read = 0;
+    uint32_t write_calls = 0; // i.e. AT+CIPSENDs, when the client underneath is a TinyGsmClient
+    uint32_t tls_records = 0; // records we've written (only meaningful when SSLClient sits on top)
+    uint32_t connects = 0;
+
+    /**
+     * @brief Zero the counters (e.g. between benchmark runs)
+     */
+    void resetCounts()
+    {
+        bytes_written = 0;
+        bytes_read = 0;
+        write_calls = 0;
+        tls_records = 0;
+        connects = 0;
+    }
+
+    int connect(IPAddress ip, uint16_t port) override
+    {
+        connects++;
+        record_header_length = 0;
+        record_remaining = 0;
+        return client.connect(ip, port);
+    }
+    int connect(const char *host, uint16_t port) override
+    {
+        connects++;
+        record_header_length = 0;
+        record_remaining = 0;
+        return client.connect(host, port);
+    }
+    size_t write(uint8_t b) override
+    {
+        return write(&b, 1);
+    }
+    size_t write(const uint8_t *buf, size_t size) override
+    {
+        size_t written = client.write(buf, size);
+        write_calls++;
+        bytes_written += written;
+        countRecords(buf, written);
+        return written;
+    }
+    int available() override
+    {
+        return client.available();
+    }
+    int read() override
+    {
+        int c = client.read();
+        if (c >= 0)
+        {
+            bytes_read++;
+        }
+        return c;
+    }
+    int read(uint8_t *buf, size_t size) override
+    {
+        int count = client.read(buf, size);
+        if (count > 0)
+        {
+            bytes_read += count;
+        }
+        return count;
+    }
+    int peek() override
+    {
+        return client.peek();
+    }
+    void flush() override
+    {
+        client.flush();
+    }
+    void stop() override
+    {
+        client.stop();
+    }
+    uint8_t connected() override
+    {
+        return client.connected();
+    }
+    operator bool() override
+    {
+        return (bool)client;
+    }
+
+private:
+    Client &client;
+    uint8_t record_header[5]; // type, version (2), length (2)
+    uint8_t record_header_length = 0;
+    uint32_t record_remaining = 0; // bytes left of the current record's body
+
+    /**
+     * @brief Follow the TLS record headers through the bytes we've written (they can be split across writes)
+     */
+    void countRecords(const uint8_t *buf, size_t size)
+    {
+        for (size_t i = 0; i < size;)
+        {
+            if (record_remaining)
+            {
+                size_t skip = min((size_t)record_remaining, size - i);
+                record_remaining -= skip;
+                i += skip;
+                continue;
+            }
+            record_header[record_header_length++] = buf[i++];
+            if (record_header_length == sizeof(record_header))
+            {
+                tls_records++;
+                record_remaining = (record_header[3] << 8) | record_header[4];
+                record_header_length = 0;
+            }
+        }
+    }
+};
@@ -0,0 +1,215 @@
+#pragma once
+
+// libs
+#include <Arduino.h>
+#include <Client.h>
+
+// Just enough HTTP/1.1 to pipeline requests on a keep-alive connection: write several requests back to back, then
+// read their responses in order. ArduinoHttpClient can't do this, it only allows one request in flight.
+namespace HTTPPipeline
+{
+    struct Request
+    {
+        const char *path;         // e.g. "/data"
+        const char *content_type; // e.g. "application/json"
+        const char *body;         // doesn't need to be null terminated
+        size_t body_length;
+        int response_status; // 0 until its response has been read
+    };
+
+    /**
+     * @brief Wait for the next byte of the response
+     *
+     * @param client the client to read from
+     * @param deadline millis() after which we give up
+     * @returns the byte, or -1 if the connection dropped or we hit the deadline
+     */
+    int readByte(Client &client, unsigned long deadline)
+    {
+        while (!client.available())
+        {
+            if (!client.connected() or (long)(millis() - deadline) >= 0)
+            {
+                return -1;
+            }
+            delay(1);
+        }
+        return client.read();
+    }
+
+    /**
+     * @brief Read one CRLF terminated line (without the CRLF), truncating it to fit the buffer
+     *
+     * @returns the length of the line, or -1 if the connection dropped or we hit the deadline
+     */
+    int readLine(Client &client, char *line, size_t size, unsigned long deadline)
+    {
+        size_t length = 0;
+        while (true)
+        {
+            int c = readByte(client, deadline);
+            if (c < 0)
+            {
+                return -1;
+            }
+            if (c == '\n')
+            {
+                break;
+            }
+            if (c != '\r' and length < size - 1)
+            {
+                line[length++] = c;
+            }
+        }
+        line[length] = '\0';
+        return length;
+    }
+
+    /**
+     * @brief Read (and throw away, bar the preview) exactly length bytes of body
+     *
+     * @returns true if we read them all, otherwise false
+     */
+    bool skipBody(Client &client, size_t length, unsigned long deadline, char *preview, size_t preview_size, size_t &preview_length)
+    {
+        for (size_t i = 0; i < length; i++)
+        {
+            int c = readByte(client, deadline);
+            if (c < 0)
+            {
+                return false;
+            }
+            if (preview_length < preview_size)
+            {
+                preview[preview_length++] = c;
+            }
+        }
+        return true;
+    }
+
+    /**
+     * @brief Write one request. It's only buffered by the client, so call client.flush() once all of them are written.
+     *
+     * @param client the (connected) client to write to
+     * @param host the Host header
+     * @param request the request
+     * @returns true if the client took all of it, otherwise false
+     */
+    bool writeRequest(Client &client, const char *host, const Request &request)
+    {
+        char header[256];
+        int header_length = snprintf(header, sizeof(header),
+                                     "POST %s HTTP/1.1\r\n"
+                                     "Host: %s\r\n"
+                                     "User-Agent: Arduino/2.2.0\r\n"
+                                     "Connection: keep-alive\r\n"
+                                     "Content-Type: %s\r\n"
+                                     "Content-Length: %u\r\n"
+                                     "\r\n",
+                                     request.path, host, request.content_type, (unsigned)request.body_length);
+        if (header_length <= 0 or header_length >= (int)sizeof(header))
+        {
+            return false;
+        }
+        return client.write((const uint8_t *)header, header_length) == (size_t)header_length and
+               client.write((const uint8_t *)request.body, request.body_length) == request.body_length;
+    }
+
+    /**
+     * @brief Read the next response off the connection, body and all, so the connection is ready for the next one
+     *
+     * @param client the client to read from
+     * @param timeout_ms how long we'll wait for the whole response
+     * @param connection_close set to true if the server is closing the connection after this response
+     * @param preview filled with the start of the body (e.g. to log it if the status is bad)
+     * @param preview_size the size of preview
+     * @param preview_length set to the number of bytes in preview
+     * @returns the status code, or -1 if the connection dropped or timed out before the whole response arrived
+     */
+    int readResponse(Client &client, unsigned long timeout_ms, bool &connection_close, char *preview, size_t preview_size, size_t &preview_length)
+    {
+        unsigned long deadline = millis() + timeout_ms;
+        char line[128];
+        int status;
+        long content_length;
+        bool chunked;
+        preview_length = 0;
+        connection_close = false;
+        do
+        // Skip any 1xx informational responses, they come before the real one
+        {
+            if (readLine(client, line, sizeof(line), deadline) < 0 or sscanf(line, "HTTP/%*d.%*d %d", &status) != 1)
+            {
+                return -1;
+            }
+            content_length = -1;
+            chunked = false;
+            int length;
+            while ((length = readLine(client, line, sizeof(line), deadline)) > 0)
+            {
+                if (strncasecmp(line, "Content-Length:", 15) == 0)
+                {
+                    content_length = atol(line + 15);
+                }
+                else if (strncasecmp(line, "Transfer-Encoding:", 18) == 0 and strstr(line + 18, "chunked"))
+                {
+                    chunked = true;
+                }
+                else if (strncasecmp(line, "Connection:", 11) == 0 and strstr(line + 11, "close"))
+                {
+                    connection_close = true;
+                }
+            }
+            if (length < 0)
+            {
+                return -1;
+            }
+        } while (status >= 100 and status < 200);
+
+        if (status == 204 or status == 304)
+        // No body, whatever the headers say
+        {
+            return status;
+        }
+        if (chunked)
+        {
+            while (true)
+            {
+                if (readLine(client, line, sizeof(line), deadline) < 0)
+                {
+                    return -1;
+                }
+                size_t chunk_length = strtoul(line, nullptr, 16);
+                if (chunk_length == 0)
+                {
+                    break;
+                }
+                if (!skipBody(client, chunk_length, deadline, preview, preview_size, preview_length) or readLine(client, line, sizeof(line), deadline) < 0)
+                {
+                    return -1;
+                }
+            }
+            int length;
+            while ((length = readLine(client, line, sizeof(line), deadline)) > 0)
+            // Trailers, up to the empty line
+            {
+            }
+            return length < 0 ? -1 : status;
+        }
+        if (content_length < 0)
+        // The body runs until the server closes the connection, so nothing can follow it
+        {
+            connection_close = true;
+            int c;
+            while ((c = readByte(client, deadline)) >= 0)
+            {
+                if (preview_length < preview_size)
+                {
+                    preview[preview_length++] = c;
+                }
+            }
+            return status;
+        }
+        return skipBody(client, content_length, deadline, preview, preview_size, preview_length) ? status : -1;
+    }
+}
@@ -0,0 +1,147 @@
+#pragma once
+
+// libs
+#include <Arduino.h>
+#include <atomic>
+
+// What a full ring does with a new item
+enum RING_OVERFLOW_POLICY_ENUM
+{
+    RING_DROP_OLDEST, // overwrite the oldest item (the newest data is usually the most useful)
+    RING_DROP_NEWEST, // refuse the new item
+    RING_BLOCK,       // wait for the consumer to make space (task context only, from an ISR this falls back to RING_DROP_NEWEST)
+};
+
+/**
+ * @brief A lock-free single-producer/single-consumer ring of fixed-size items.
+ *
+ * One task (or ISR) pushes, one task pops. Neither side ever takes a lock, so a producer never waits on the uploader
+ * (and therefore never on the modem), unless you explicitly ask for RING_BLOCK.
+ * Dropping the oldest item means the producer advances the tail, so the consumer claims each item with a
+ * compare-and-swap and simply discards its copy if the producer got there first.
+ *
+ * @tparam T the item type (keep it a small, trivially copyable struct)
+ * @tparam N the number of slots, must be a power of two
+ */
+template <typename T, uint32_t N>
+class SPSCRing
+{
+    static_assert(N >= 2 and (N & (N - 1)) == 0, "SPSCRing length must be a power of two");
+
+public:
+    explicit SPSCRing(RING_OVERFLOW_POLICY_ENUM overflow_policy = RING_DROP_OLDEST)
+        : policy(overflow_policy), head(0), tail(0), pushed(0), popped(0), dropped(0), high_water(0)
+    {
+    }
+
+    /**
+     * @brief Push an item (producer side)
+     *
+     * @param item the item to copy into the ring
+     * @param block_ticks how long to wait for space under RING_BLOCK
+     * @returns true if the item was queued, false if it was dropped
+     */
+    bool push(const T &item, TickType_t block_ticks = portMAX_DELAY)
+    {
+        uint32_t this_head = head.load(std::memory_order_relaxed);
+        uint32_t this_tail = tail.load(std::memory_order_acquire);
+        TickType_t waited = 0;
+        while (this_head - this_tail >= N)
+        // Full
+        {
+            if (policy == RING_DROP_OLDEST)
+            {
+                if (tail.compare_exchange_weak(this_tail, this_tail + 1, std::memory_order_acq_rel, std::memory_order_acquire))
+                {
+                    dropped.fetch_add(1, std::memory_order_relaxed);
+                    this_tail++;
+                }
+                continue; // on failure this_tail was reloaded, the consumer may have made space for us
+            }
+            if (policy == RING_BLOCK and !xPortInIsrContext() and waited < block_ticks)
+            {
+                vTaskDelay(1);
+                waited++;
+                this_tail = tail.load(std::memory_order_acquire);
+                continue;
+            }
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+
+        slots[this_head & (N - 1)] = item;
+        head.store(this_head + 1, std::memory_order_release);
+        pushed.fetch_add(1, std::memory_order_relaxed);
+
+        uint32_t depth = this_head + 1 - this_tail;
+        if (depth > high_water.load(std::memory_order_relaxed))
+        {
+            high_water.store(depth, std::memory_order_relaxed);
+        }
+        return true;
+    }
+
+    /**
+     * @brief Push an item from an ISR (never blocks)
+     *
+     * @param item the item to copy into the ring
+     * @returns true if the item was queued, false if it was dropped
+     */
+    bool pushFromISR(const T &item)
+    {
+        return push(item, 0);
+    }
+
+    /**
+     * @brief Pop up to max_items items in one go (consumer side)
+     *
+     * @param out where to copy the items to
+     * @param max_items the size of out
+     * @returns the number of items copied into out
+     */
+    size_t popBatch(T *out, size_t max_items)
+    {
+        size_t count = 0;
+        while (count < max_items)
+        {
+            uint32_t this_tail = tail.load(std::memory_order_acquire);
+            if (this_tail == head.load(std::memory_order_acquire))
+            // Empty
+            {
+                break;
+            }
+            out[count] = slots[this_tail & (N - 1)];
+            if (tail.compare_exchange_strong(this_tail, this_tail + 1, std::memory_order_acq_rel, std::memory_order_acquire))
+            {
+                count++;
+            }
+            // otherwise the producer dropped this item while we were copying it, so our copy is stale. Try the next.
+        }
+        popped.fetch_add(count, std::memory_order_relaxed);
+        return count;
+    }
+
+    /**
+     * @brief The number of items currently queued (a snapshot, it may change as soon as you read it)
+     */
+    uint32_t size() const
+    {
+        return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire);
+    }
+
+    uint32_t capacity() const { return N; }
+    uint32_t pushedCount() const { return pushed.load(std::memory_order_relaxed); }
+    uint32_t poppedCount() const { return popped.load(std::memory_order_relaxed); }
+    uint32_t droppedCount() const { return dropped.load(std::memory_order_relaxed); }
+    uint32_t highWater() const { return high_water.load(std::memory_order_relaxed); }
+
+private:
+    const RING_OVERFLOW_POLICY_ENUM policy;
+    T slots[N];
+    std::atomic<uint32_t> head; // next slot to write, only the producer moves it
+    std::atomic<uint32_t> tail; // next slot to read, the consumer moves it (and the producer does when dropping the oldest)
+    std::atomic<uint32_t> pushed;
+    std::atomic<uint32_t> popped;
+    std::atomic<uint32_t> dropped;
+    std::atomic<uint32_t> high_water;
+};
@@ -0,0 +1,349 @@
+#pragma once
+
+// libs
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <math.h>
+
+/*
+ * Compile-time telemetry schemas. Declare a record once, as an X-macro list of (type, name, aggregation, deadband):
+ *
+ *   #define MY_RECORD_FIELDS(X)           \
+ *       X(uint32_t, time, LAST, 0)        \
+ *       X(float, temperature, STATS, 0.5f)
+ *   DECLARE_TELEMETRY_SCHEMA(MyRecord, MY_RECORD_FIELDS)
+ *
+ * and the compiler generates:
+ *   - MyRecord, a fixed-size struct of those fields
+ *   - MyRecordWindow, its windowed aggregate (STATS fields get min/max/mean/last, LAST fields keep the last value)
+ *   - MyRecordSchema, with zero-allocation JSON and binary writers for both, a parser, an ArduinoJson filter for
+ *     inbound documents, a send-on-change test against each field's deadband (0 means any change counts), and the
+ *     worst case size of every encoding as a compile-time constant.
+ *
+ * Every schema needs a uint32_t "time" field (unix time), which is what the windows are stamped with.
+ * Keys are string literals baked in at compile time, nothing is looked up or allocated when encoding.
+ */
+namespace Schema
+{
+    // Worst case JSON characters per type
+    template <typename T>
+    struct Traits;
+    template <>
+    struct Traits<uint8_t>
+    {
+        enum { JSON_MAX_CHARS = 3 };
+    };
+    template <>
+    struct Traits<int8_t>
+    {
+        enum { JSON_MAX_CHARS = 4 };
+    };
+    template <>
+    struct Traits<uint16_t>
+    {
+        enum { JSON_MAX_CHARS = 5 };
+    };
+    template <>
+    struct Traits<int16_t>
+    {
+        enum { JSON_MAX_CHARS = 6 };
+    };
+    template <>
+    struct Traits<uint32_t>
+    {
+        enum { JSON_MAX_CHARS = 10 };
+    };
+    template <>
+    struct Traits<int32_t>
+    {
+        enum { JSON_MAX_CHARS = 11 };
+    };
+    template <>
+    struct Traits<float>
+    {
+        enum { JSON_MAX_CHARS = 14 }; // "%.7g", e.g. -1.234567e+38
+    };
+
+    struct FieldAggregate
+    {
+        float min;
+        float max;
+        float mean; // updated incrementally, so there's no running sum to overflow or lose precision
+        float last;
+    };
+
+    enum
+    {
+        FIELD_AGGREGATE_JSON_MAX_CHARS = sizeof("{\"min\":,\"max\":,\"mean\":,\"last\":}") - 1 + 4 * Traits<float>::JSON_MAX_CHARS,
+        FIELD_AGGREGATE_BINARY_SIZE = 4 * sizeof(float),
+        WINDOW_HEADER_JSON_MAX_CHARS = sizeof("\"window_start\":,\"window_end\":,\"count\":") - 1 + 3 * Traits<uint32_t>::JSON_MAX_CHARS,
+        WINDOW_HEADER_BINARY_SIZE = 3 * sizeof(uint32_t),
+    };
+
+    /**
+     * @brief Fold one value into a field's aggregate
+     *
+     * @param field the aggregate to update
+     * @param value the new value
+     * @param count the number of samples in the window, including this one
+     */
+    inline void updateField(FieldAggregate &field, float value, uint32_t count)
+    {
+        if (count == 1)
+        {
+            field.min = value;
+            field.max = value;
+            field.mean = value;
+        }
+        else
+        {
+            field.min = value < field.min ? value : field.min;
+            field.max = value > field.max ? value : field.max;
+            field.mean += (value - field.mean) / count;
+        }
+        field.last = value;
+    }
+
+    // Writes JSON into a caller-owned buffer (size it with the schema's *_JSON_MAX_SIZE constants)
+    class JsonWriter
+    {
+    public:
+        JsonWriter(char *buffer, size_t size) : start(buffer), cursor(buffer), end(buffer + size), overflow(false)
+        {
+            *cursor = '\0';
+        }
+
+        void raw(const char *text) { advance(snprintf(cursor, end - cursor, "%s", text)); }
+        void value(uint8_t number) { advance(snprintf(cursor, end - cursor, "%u", (unsigned)number)); }
+        void value(int8_t number) { advance(snprintf(cursor, end - cursor, "%d", (int)number)); }
+        void value(uint16_t number) { advance(snprintf(cursor, end - cursor, "%u", (unsigned)number)); }
+        void value(int16_t number) { advance(snprintf(cursor, end - cursor, "%d", (int)number)); }
+        void value(uint32_t number) { advance(snprintf(cursor, end - cursor, "%lu", (unsigned long)number)); }
+        void value(int32_t number) { advance(snprintf(cursor, end - cursor, "%ld", (long)number)); }
+        void value(float number)
+        {
+            if (!isfinite(number))
+            // JSON has no NaN or infinity
+            {
+                raw("null");
+                return;
+            }
+            advance(snprintf(cursor, end - cursor, "%.7g", (double)number));
+        }
+        void value(const FieldAggregate &field)
+        {
+            raw("{\"min\":");
+            value(field.min);
+            raw(",\"max\":");
+            value(field.max);
+            raw(",\"mean\":");
+            value(field.mean);
+            raw(",\"last\":");
+            value(field.last);
+            raw("}");
+        }
+
+        size_t length() const { return cursor - start; }
+        bool overflowed() const { return overflow; }
+
+    private:
+        char *start;
+        char *cursor;
+        char *end;
+        bool overflow;
+
+        void advance(int written)
+        {
+            if (written < 0)
+            {
+                return;
+            }
+            if (written >= end - cursor)
+            // snprintf truncated us (and left a null terminator at end - 1)
+            {
+                overflow = true;
+                cursor = end - 1;
+                return;
+            }
+            cursor += written;
+        }
+    };
+
+    /**
+     * @brief Check if a value moved by more than its deadband (computed in the value's own type, so a uint32_t
+     * timestamp doesn't lose its low bits to a float)
+     */
+    template <typename T>
+    bool movedBeyond(T value, T last, float deadband)
+    {
+        return value > last ? value - last > deadband : last - value > deadband;
+    }
+
+    // Writes packed little-endian binary into a caller-owned buffer (size it with the schema's *_BINARY_SIZE constants)
+    class BinaryWriter
+    {
+    public:
+        explicit BinaryWriter(uint8_t *buffer) : start(buffer), cursor(buffer) {}
+
+        template <typename T>
+        void value(const T &number)
+        {
+            memcpy(cursor, &number, sizeof(T)); // the ESP32 is little-endian already
+            cursor += sizeof(T);
+        }
+        void value(const FieldAggregate &field)
+        {
+            value(field.min);
+            value(field.max);
+            value(field.mean);
+            value(field.last);
+        }
+
+        size_t length() const { return cursor - start; }
+
+    private:
+        uint8_t *start;
+        uint8_t *cursor;
+    };
+}
+
+// -- Per-field expansions used by DECLARE_TELEMETRY_SCHEMA
+#define SCHEMA_RECORD_MEMBER(type, name, aggregation, deadband) type name;
+#define SCHEMA_WINDOW_MEMBER(type, name, aggregation, deadband) SCHEMA_WINDOW_MEMBER_##aggregation(type, name)
+#define SCHEMA_WINDOW_MEMBER_STATS(type, name) Schema::FieldAggregate name;
+#define SCHEMA_WINDOW_MEMBER_LAST(type, name) type name;
+
+#define SCHEMA_COUNT(type, name, aggregation, deadband) +1
+#define SCHEMA_KEY_CHARS(type, name, aggregation, deadband) +sizeof(#name)
+#define SCHEMA_RECORD_JSON_SIZE(type, name, aggregation, deadband) +(sizeof(",\"" #name "\":") - 1) + Schema::Traits<type>::JSON_MAX_CHARS
+#define SCHEMA_WINDOW_JSON_SIZE(type, name, aggregation, deadband) +(sizeof(",\"" #name "\":") - 1) + SCHEMA_WINDOW_JSON_CHARS_##aggregation(type)
+#define SCHEMA_WINDOW_JSON_CHARS_STATS(type) Schema::FIELD_AGGREGATE_JSON_MAX_CHARS
+#define SCHEMA_WINDOW_JSON_CHARS_LAST(type) Schema::Traits<type>::JSON_MAX_CHARS
+#define SCHEMA_RECORD_BINARY_SIZE(type, name, aggregation, deadband) +sizeof(type)
+#define SCHEMA_WINDOW_BINARY_SIZE(type, name, aggregation, deadband) +SCHEMA_WINDOW_BINARY_SIZE_##aggregation(type)
+#define SCHEMA_WINDOW_BINARY_SIZE_STATS(type) Schema::FIELD_AGGREGATE_BINARY_SIZE
+#define SCHEMA_WINDOW_BINARY_SIZE_LAST(type) sizeof(type)
+
+#define SCHEMA_WRITE_JSON(type, name, aggregation, deadband) \
+    writer.raw(",\"" #name "\":" + (first ? 1 : 0)); \
+    writer.value(source.name);                       \
+    first = false;
+#define SCHEMA_WRITE_BINARY(type, name, aggregation, deadband) writer.value(source.name);
+#define SCHEMA_FILTER(type, name, aggregation, deadband) filter[#name] = true;
+#define SCHEMA_FROM_JSON(type, name, aggregation, deadband) record.name = object[#name].as<type>();
+#define SCHEMA_ADD_TO_WINDOW(type, name, aggregation, deadband) SCHEMA_ADD_TO_WINDOW_##aggregation(name)
+#define SCHEMA_ADD_TO_WINDOW_STATS(name) Schema::updateField(window.name, (float)record.name, window.count);
+#define SCHEMA_ADD_TO_WINDOW_LAST(name) window.name = record.name;
+#define SCHEMA_HAS_CHANGED(type, name, aggregation, deadband)       \
+    if (Schema::movedBeyond(record.name, last_sent.name, deadband)) \
+    {                                                               \
+        return true;                                                \
+    }
+
+/**
+ * @brief Generate a record struct, its window aggregate struct, and their encoders from one field list
+ *
+ * @param NAME the record's type name (NAME##Window and NAME##Schema are generated alongside it)
+ * @param FIELDS an X-macro listing X(type, name, STATS|LAST, deadband) for every field
+ */
+#define DECLARE_TELEMETRY_SCHEMA(NAME, FIELDS)                                                                          \
+    struct NAME                                                                                                         \
+    {                                                                                                                   \
+        FIELDS(SCHEMA_RECORD_MEMBER)                                                                                    \
+    };                                                                                                                  \
+                                                                                                                        \
+    struct NAME##Window                                                                                                 \
+    {                                                                                                                   \
+        uint32_t window_start; /* time of the first sample in the window */                                             \
+        uint32_t window_end;   /* time of the last sample in the window */                                              \
+        uint32_t count;        /* number of samples in the window */                                                    \
+        FIELDS(SCHEMA_WINDOW_MEMBER)                                                                                    \
+    };                                                                                                                  \
+                                                                                                                        \
+    struct NAME##Schema                                                                                                 \
+    {                                                                                                                   \
+        enum                                                                                                            \
+        {                                                                                                               \
+            FIELD_COUNT = 0 FIELDS(SCHEMA_COUNT),                                                                       \
+            /* worst case sizes, including the null terminator (the first field has no comma, which pays for it) */     \
+            JSON_MAX_SIZE = 2 FIELDS(SCHEMA_RECORD_JSON_SIZE),                                                          \
+            WINDOW_JSON_MAX_SIZE = 2 + Schema::WINDOW_HEADER_JSON_MAX_CHARS FIELDS(SCHEMA_WINDOW_JSON_SIZE) + 1,        \
+            BINARY_SIZE = 0 FIELDS(SCHEMA_RECORD_BINARY_SIZE),                                                          \
+            WINDOW_BINARY_SIZE = Schema::WINDOW_HEADER_BINARY_SIZE FIELDS(SCHEMA_WINDOW_BINARY_SIZE),                   \
+            /* what deserializeJson needs for one filtered record (the keys are copied from the stream) */              \
+            PARSE_DOC_SIZE = JSON_OBJECT_SIZE(FIELD_COUNT) FIELDS(SCHEMA_KEY_CHARS),                                    \
+        };                                                                                                              \
+                                                                                                                        \
+        static size_t writeJson(const NAME &source, char *out, size_t size)                                             \
+        {                                                                                                               \
+            Schema::JsonWriter writer(out, size);                                                                       \
+            bool first = true;                                                                                          \
+            writer.raw("{");                                                                                            \
+            FIELDS(SCHEMA_WRITE_JSON)                                                                                   \
+            writer.raw("}");                                                                                            \
+            (void)first;                                                                                                \
+            return writer.overflowed() ? 0 : writer.length();                                                           \
+        }                                                                                                               \
+                                                                                                                        \
+        static size_t writeWindowJson(const NAME##Window &source, char *out, size_t size)                               \
+        {                                                                                                               \
+            Schema::JsonWriter writer(out, size);                                                                       \
+            bool first = false;                                                                                         \
+            writer.raw("{\"window_start\":");                                                                           \
+            writer.value(source.window_start);                                                                          \
+            writer.raw(",\"window_end\":");                                                                             \
+            writer.value(source.window_end);                                                                            \
+            writer.raw(",\"count\":");                                                                                  \
+            writer.value(source.count);                                                                                 \
+            FIELDS(SCHEMA_WRITE_JSON)                                                                                   \
+            writer.raw("}");                                                                                            \
+            (void)first;                                                                                                \
+            return writer.overflowed() ? 0 : writer.length();                                                           \
+        }                                                                                                               \
+                                                                                                                        \
+        static size_t writeBinary(const NAME &source, uint8_t *out)                                                     \
+        {                                                                                                               \
+            Schema::BinaryWriter writer(out);                                                                           \
+            FIELDS(SCHEMA_WRITE_BINARY)                                                                                 \
+            return writer.length();                                                                                     \
+        }                                                                                                               \
+                                                                                                                        \
+        static size_t writeWindowBinary(const NAME##Window &source, uint8_t *out)                                       \
+        {                                                                                                               \
+            Schema::BinaryWriter writer(out);                                                                           \
+            writer.value(source.window_start);                                                                          \
+            writer.value(source.window_end);                                                                            \
+            writer.value(source.count);                                                                                 \
+            FIELDS(SCHEMA_WRITE_BINARY)                                                                                 \
+            return writer.length();                                                                                     \
+        }                                                                                                               \
+                                                                                                                        \
+        /* mark every field of the record as wanted, for DeserializationOption::Filter */                              \
+        static void buildFilter(JsonObject filter)                                                                      \
+        {                                                                                                               \
+            FIELDS(SCHEMA_FILTER)                                                                                       \
+        }                                                                                                               \
+                                                                                                                        \
+        static void fromJson(JsonVariantConst object, NAME &record)                                                     \
+        {                                                                                                               \
+            FIELDS(SCHEMA_FROM_JSON)                                                                                    \
+        }                                                                                                               \
+                                                                                                                        \
+        static void addToWindow(NAME##Window &window, const NAME &record)                                               \
+        {                                                                                                               \
+            window.count++;                                                                                             \
+            if (window.count == 1)                                                                                      \
+            {                                                                                                           \
+                window.window_start = record.time;                                                                      \
+            }                                                                                                           \
+            window.window_end = record.time;                                                                            \
+            FIELDS(SCHEMA_ADD_TO_WINDOW)                                                                                \
+        }                                                                                                               \
+                                                                                                                        \
+        /* true if any field moved by more than its deadband since the record we last sent */                          \
+        static bool hasChanged(const NAME &record, const NAME &last_sent)                                               \
+        {                                                                                                               \
+            FIELDS(SCHEMA_HAS_CHANGED)                                                                                  \
+            return false;                                                                                               \
+        }                                                                                                               \
+    };
@@ -0,0 +1,51 @@
+# Prints each build's flash and RAM footprint, tagged with the SIMCOM module it was built for, e.g.
+#   FOOTPRINT,module_sim7070g,SIM7070G,flash=1034567,ram=45678
+# and keeps the latest line per env in .pio/build/footprint.csv, so the module_* envs can be compared side by side:
+#   pio run -e module_sim7000x -e module_sim7070g -e module_sim7600x -e module_a7672x
+# Flash and RAM are counted the way `pio run` counts them (the size tool's sections, matched by the platform's regexes).
+
+import os
+import re
+import subprocess
+
+Import("env")
+
+MODULES = ("SIM7000x", "SIM7070G", "SIM7600x", "A7672x")
+DEFAULT_MODULE = "HARDWARE_config.h"  # no -D picks one, so it's whatever HARDWARE_config.h defines
+
+# What the espressif32 platform uses, in case the env doesn't say
+FLASH_SECTIONS = r"^(?:\.iram0\.text|\.iram0\.vectors|\.dram0\.data|\.flash\.text|\.flash\.rodata|)\s+([0-9]+).*"
+RAM_SECTIONS = r"^(?:\.dram0\.data|\.dram0\.bss|\.noinit)\s+([0-9]+).*"
+
+
+def module_name(env):
+    for define in env.get("CPPDEFINES", []):
+        name = define[0] if isinstance(define, (list, tuple)) else define
+        if name in MODULES:
+            return name
+    return DEFAULT_MODULE
+
+
+def section_total(sizes, pattern):
+    return sum(int(match.group(1)) for match in re.finditer(pattern, sizes, re.M))
+
+
+def print_footprint(source, target, env):
+    elf = str(target[0])
+    sizes = subprocess.check_output([env.subst("$SIZETOOL"), "-A", "-d", elf]).decode()
+    flash = section_total(sizes, env.get("SIZEPROGREGEXP", FLASH_SECTIONS))
+    ram = section_total(sizes, env.get("SIZEDATAREGEXP", RAM_SECTIONS))
+    line = "FOOTPRINT,%s,%s,flash=%d,ram=%d" % (env["PIOENV"], module_name(env), flash, ram)
+    print(line)
+
+    csv_path = os.path.join(env.subst("$PROJECT_BUILD_DIR"), "footprint.csv")
+    lines = []
+    if os.path.exists(csv_path):
+        with open(csv_path) as csv:
+            lines = [old for old in csv.read().splitlines() if not old.startswith("FOOTPRINT,%s," % env["PIOENV"])]
+    lines.append(line)
+    with open(csv_path, "w") as csv:
+        csv.write("\n".join(sorted(lines)) + "\n")
+
+
+env.AddPostAction("$BUILD_DIR/${PROGNAME}.elf", print_footprint)
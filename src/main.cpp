@@ -5,10 +5,15 @@
 #include <configs/HARDWARE_config.h>
 #include <configs/OPERATIONS_config.h>
 #include <configs/BRICKS_config.h>
+#include <configs/MQTT_config.h>
 
 // bricks
 #include <inits/firmware_details_init.h>
 #include <http_handler.h>
+#include <mqtt_handler.h>
+#include <bricks/ota_handler.h>
+#include <bricks/change_filter.h>
+#include <bricks/task_monitor.h>
 
 // libs
 #include <StatusLogger.h>
@@ -17,18 +22,31 @@
 #define DEFAULT_LAT 48.82
 #define DEFAULT_LON 2.38
 
-const int DELAY_DATA_TIME = 30 * 1000;    // Perform the data stream every 30 seconds
+const int DELAY_DATA_TIME = 30 * 1000;    // Sample the meteo data every 30 seconds (your own sensors can sample far faster)
+const int DELAY_UPLOAD_TIME = 30 * 1000;  // Upload the closed aggregation windows every 30 seconds
 const int DELAY_STATUS_TIME = 120 * 1000; // Perform a status report every 2 minutes
+const unsigned long DELAY_OTA_CHECK_TIME = 6 * 3600 * 1000UL; // Check for new firmware every 6 hours
 
 unsigned long last_data_time = 0;
+unsigned long last_upload_time = 0;
 unsigned long last_status_time = 0;
+unsigned long last_ota_check_time = 0;
 
-LoopbackStream working_stream(4000); // A working loopback stream, use this like super-flexible strings ;)
+LoopbackStream working_stream(4000); // A working loopback stream, use this like super-flexible strings ;) (loop() only, it isn't thread-safe)
+
+Aggregation::WindowAggregate upload_batch[TELEMETRY_UPLOAD_BATCH]; // Aggregates popped from the queue, kept until they're posted
+size_t upload_batch_count = 0;
 
 void setup()
 {
     // Set up all serial connections and misc. pins and run a systems checks
     Serial.begin(SERIAL_MON_BAUD);
+    LogSink::begin(); // Hot path logs are written out to Serial by a low priority task from here on
+    TaskMonitor::begin(); // Calibrate the CPU monitor (if on) now, while both cores are still (nearly) idle
+    ModemTask::begin();   // From here on only the modem task talks to the SIMCOM module, setup and loop() hand it jobs
+    TaskMonitor::watch("loop", xTaskGetCurrentTaskHandle());
+    TaskMonitor::watch("modem_io", ModemTask::task);
+    TaskMonitor::watch("log_sink", LogSink::drain_task);
     Firmware::init();
 
     // Connect to the simcom module
@@ -53,11 +71,16 @@ void setup()
     }
     StatusLogger::setBrickStatus(StatusLogger::NAME_SIMCOM, StatusLogger::FUNCTIONALITY_PARTIAL, "We AT commanded and there is a SIM card, that's a good start.");
 
-    // Connect to the Internet
+    // Connect to the Internet (backing off between attempts so we don't hammer the network)
+    uint8_t internet_attempts = 0;
     while (SIMCOMHandler::connectToInternet() != SIMCOMHandler::INTERNET_READY)
     {
         StatusLogger::setBrickStatus(StatusLogger::NAME_SIMCOM, StatusLogger::FUNCTIONALITY_OFFLINE, "We couldn't connect to the internet :(");
-        delay(2000);
+        if (internet_attempts < 255)
+        {
+            internet_attempts++;
+        }
+        delay(SIMCOMHandler::backoffDelay(internet_attempts));
     }
 
     // Update the SSL time from the cell tower, this is necessary for SSL endpoints.
@@ -69,25 +92,17 @@ void setup()
 
 void loop()
 {
-    // Task 1 - Upload the current meteo data to our beeceptor data endpoint
+    // Task 1 - Get the current meteo data and queue it as a raw sample (any other producer would push to the queue the same way)
     if ((millis() - last_data_time) > DELAY_DATA_TIME)
     {
-        // Get Meteo data
-        HTTP::large_doc = HTTP::getMeteorologicalData(DEFAULT_LAT, DEFAULT_LON);
-
-        // Filter Meteo data
-        if (HTTP::large_doc.containsKey("current_weather"))
+        // Get Meteo data (filtered down to the telemetry schema's fields as it's parsed)
+        Telemetry::TelemetryRecord sample;
+        if (HTTP::getMeteorologicalData(DEFAULT_LAT, DEFAULT_LON, sample))
         {
-            HTTP::small_doc = HTTP::large_doc["current_weather"];
-
-            // Post Meteo data
-            if (HTTP::postMeteorologicalData(HTTP::small_doc))
-            {
-                StatusLogger::setBrickStatus(StatusLogger::NAME_BEECEPTOR, StatusLogger::FUNCTIONALITY_FULL, "Meteo data is up to date on beeceptor.");
-            }
-            else
+            if (ChangeFilter::shouldSend(sample))
+            // Only a new observation (or the heartbeat) is worth aggregating and uploading
             {
-                StatusLogger::setBrickStatus(StatusLogger::NAME_BEECEPTOR, StatusLogger::FUNCTIONALITY_PARTIAL, "unable to post the Meteo data to beeceptor.");
+                Telemetry::pushRecord(sample);
             }
         }
         else
@@ -97,11 +112,75 @@ void loop()
         last_data_time = millis();
     }
 
-    // Task 2 - Upload our brick health to our beeceptor device endpoint
-    if ((millis() - last_status_time) > DELAY_STATUS_TIME)
+    // Task 2 - Fold the raw samples into the current window, and pick up the closed windows when they're due for upload
+    Aggregation::update();
+    bool is_upload_due = (millis() - last_upload_time) > DELAY_UPLOAD_TIME;
+    if (is_upload_due and upload_batch_count == 0)
+    {
+        upload_batch_count = Aggregation::closed_windows.popBatch(upload_batch, TELEMETRY_UPLOAD_BATCH);
+    }
+
+    // Task 3 - Put together our brick health report when it's due
+    bool is_status_due = (millis() - last_status_time) > DELAY_STATUS_TIME;
+    String statuses_string;
+    if (is_status_due)
     {
         StatusLogger::printBrickStatuses(&working_stream);
-        if (HTTP::postStatuses(working_stream.readString()))
+        SIMCOMHandler::printEndpointMetrics(&working_stream);
+        SIMCOMHandler::printWriteMetrics(&working_stream);
+        if (!SimcomModem::SSL_ON_MODEM)
+        // The modem resolves the host names itself when it does TLS
+        {
+            DNSCache::printDNSMetrics(&working_stream);
+        }
+        Telemetry::printQueueMetrics(&working_stream);
+        ChangeFilter::printChangeFilterMetrics(&working_stream);
+        Aggregation::printAggregationMetrics(&working_stream);
+        OTA::printOTAMetrics(&working_stream);
+        LogSink::printLogMetrics(&working_stream);
+        ModemTask::printModemTaskMetrics(&working_stream);
+        TaskMonitor::printTaskMetrics(&working_stream);
+#ifdef UPLOAD_TRANSPORT_MQTT
+        MQTT::printMQTTMetrics(&working_stream);
+#else
+        HTTP::printPipelineMetrics(&working_stream);
+#endif
+        statuses_string = working_stream.readString();
+    }
+
+    // Tasks 2 & 3 - Upload the windows to our data endpoint and the report to our device endpoint (over HTTP, both
+    // go out pipelined on one connection when they're due together)
+    bool data_posted = false;
+    bool statuses_posted = false;
+#ifdef UPLOAD_TRANSPORT_MQTT
+    if (is_upload_due and upload_batch_count)
+    {
+        data_posted = MQTT::publishAggregates(upload_batch, upload_batch_count);
+    }
+    if (is_status_due)
+    {
+        statuses_posted = MQTT::publishStatuses(statuses_string);
+    }
+#else
+    HTTP::postUploads(upload_batch, is_upload_due ? upload_batch_count : 0, statuses_string, data_posted, statuses_posted);
+#endif
+    if (is_upload_due)
+    {
+        if (data_posted)
+        {
+            StatusLogger::setBrickStatus(StatusLogger::NAME_BEECEPTOR, StatusLogger::FUNCTIONALITY_FULL, "Meteo data is up to date on beeceptor.");
+            upload_batch_count = 0;
+        }
+        else if (upload_batch_count)
+        // Keep the batch, we'll try it again next time
+        {
+            StatusLogger::setBrickStatus(StatusLogger::NAME_BEECEPTOR, StatusLogger::FUNCTIONALITY_PARTIAL, "unable to post the Meteo data to beeceptor.");
+        }
+        last_upload_time = millis();
+    }
+    if (is_status_due)
+    {
+        if (statuses_posted)
         {
             StatusLogger::setBrickStatus(StatusLogger::NAME_METEO, StatusLogger::FUNCTIONALITY_FULL, "Statuses up to date on beeceptor.");
         }
@@ -112,6 +191,22 @@ void loop()
         last_status_time = millis();
     }
 
+    // Task 4 - Check for new firmware (straight away if a download was interrupted), then download it one range per loop
+    if (OTA::state == OTA::OTA_DOWNLOADING)
+    {
+        OTA::downloadNextRange();
+    }
+    else if ((millis() - last_ota_check_time) > DELAY_OTA_CHECK_TIME or (last_ota_check_time == 0 and OTA::hasPendingDownload()))
+    {
+        OTA::checkForUpdate();
+        last_ota_check_time = millis();
+    }
+
+#ifdef UPLOAD_TRANSPORT_MQTT
+    // Keep the MQTT session alive between uploads (keepalive pings, acks)
+    MQTT::loop();
+#endif
+
     // Delay til next tick
     delay(1000);       // delay 1 second
     Serial.print("."); // have a visible tick just so we can ensure our board is working